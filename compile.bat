@@ -1,3 +1,7 @@
 C:\VulkanSDK\1.4.304.1\Bin\glslc.exe simple_shader.vert -o simple_shader.vert.spv
 C:\VulkanSDK\1.4.304.1\Bin\glslc.exe simple_shader.frag -o simple_shader.frag.spv
+C:\VulkanSDK\1.4.304.1\Bin\glslc.exe instanced_shader.vert -o instanced_shader.vert.spv
+C:\VulkanSDK\1.4.304.1\Bin\glslc.exe cull.comp -o cull.comp.spv
+C:\VulkanSDK\1.4.304.1\Bin\glslc.exe -DOCCLUSION cull.comp -o cull_occlusion.comp.spv
+C:\VulkanSDK\1.4.304.1\Bin\glslc.exe depth_pyramid.comp -o depth_pyramid.comp.spv
 pause
\ No newline at end of file
@@ -2,127 +2,681 @@
 
 // std
 #include <stdexcept>
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
 
 namespace tv
 {
-	FirstApp::FirstApp()
+	// per draw data, pushed right into the command buffer (has to match the push_constant block in simple_shader.vert)
+	struct SimplePushConstantData
 	{
+		glm::mat2 transform{ 1.0f };
+		glm::vec2 offset;
+		alignas(16) glm::vec3 color;
+	};
+
+	// the camera, every path applies it after the object's own transform
+	static SimplePushConstantData viewTransform(float zoom)
+	{
+		SimplePushConstantData view{};
+		view.transform = glm::mat2{ zoom };
+		view.offset = { 0.0f, 0.0f };
+		view.color = { 1.0f, 1.0f, 1.0f };
+		return view;
+	}
+
+	// what the vertex shaders do with the view as a matrix (x' = transform * x + offset, z and w passed through)
+	static glm::mat4 viewProjection(const SimplePushConstantData& view)
+	{
+		glm::mat4 matrix{ 1.0f };
+		matrix[0][0] = view.transform[0][0];
+		matrix[0][1] = view.transform[0][1];
+		matrix[1][0] = view.transform[1][0];
+		matrix[1][1] = view.transform[1][1];
+		matrix[3][0] = view.offset.x;
+		matrix[3][1] = view.offset.y;
+		return matrix;
+	}
+
+	// the draws go in a grid over the whole screen, each one scaled down to fit its cell and colored by where it is
+	static uint32_t gridColumns(uint32_t drawCount)
+	{
+		return static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(drawCount))));
+	}
+
+	static TvInstanceBuffer::InstanceData gridInstance(uint32_t draw, uint32_t columns)
+	{
+		const float cellSize = 2.0f / static_cast<float>(columns);
+		const uint32_t column = draw % columns;
+		const uint32_t row = draw / columns;
+		TvInstanceBuffer::InstanceData instance;
+		instance.transform = glm::mat2{ cellSize };
+		instance.offset = { -1.0f + cellSize * (column + 0.5f), -1.0f + cellSize * (row + 0.5f) };
+		instance.depth = 0.0f;
+		instance.color = { (column + 0.5f) / columns, (row + 0.5f) / columns, 0.5f };
+		return instance;
+	}
+
+	// the occlusion demo puts this many big quads (mesh 1) in front of the grid, tiling [-0.8, 0.8] on both axes, so
+	// most of the grid behind them is hidden
+	static constexpr uint32_t OCCLUDER_COUNT = 4;
+	static constexpr float OCCLUDER_DEPTH = 0.1f;
+	static constexpr float GRID_DEPTH = 0.9f;
+
+	static TvInstanceBuffer::InstanceData occluderInstance(uint32_t occluder)
+	{
+		TvInstanceBuffer::InstanceData instance;
+		instance.transform = glm::mat2{ 1.0f };
+		instance.offset = { occluder % 2 == 0 ? -0.4f : 0.4f, occluder / 2 == 0 ? -0.4f : 0.4f };
+		instance.depth = OCCLUDER_DEPTH;
+		instance.color = { 0.35f, 0.35f, 0.35f };
+		return instance;
+	}
+
+	FirstApp::FirstApp(const AppOptions& options)
+		: options{ options },
+		tvWindow{ static_cast<int>(options.width), static_cast<int>(options.height), "Hello Vulkan", options.headless }
+	{
+		loadShaders();
+		if (options.hotReload)
+		{
+			shaderWatcher = std::make_unique<TvShaderWatcher>(std::vector<ShaderSource>{
+				{ "simple_shader.vert", "simple_shader.vert.spv" },
+				{ "simple_shader.frag", "simple_shader.frag.spv" },
+				{ "instanced_shader.vert", "instanced_shader.vert.spv" } });
+		}
+		loadModels();
 		createPipelineLayout();
-		createPipeline();
-		createCommandBuffers();
+		recreateSwapChain();
 	}
 
 	FirstApp::~FirstApp()
 	{
-		vkDestroyPipelineLayout(tvDevice.device(), pipelineLayout, nullptr);
+		// the frame pools and timer go away with us, the gpu can't still be using them
+		frameTimeline.waitForFrame(frameTimeline.lastSubmittedFrame());
+		// and nothing can still be compiling against the layout
+		pipelineCompiler.waitIdle();
 	}
 
 	void FirstApp::Run()
 	{
+		auto startTime = std::chrono::steady_clock::now();
+		uint32_t framesDrawn = 0;
+
 		// Self explanatory while loop game programming here
-		while (!tvWindow.shouldClose())
+		// (plus a frame budget so headless runs actually end)
+		while (!tvWindow.shouldClose() && (options.frameCount == 0 || framesDrawn < options.frameCount))
 		{
-			glfwPollEvents();
+			if (!tvWindow.isHeadless())
+			{
+				glfwPollEvents();
+			}
 			drawFrame();
+			framesDrawn++;
+			// cheap unless a pipeline got created since the last save
+			pipelineCache.saveIfDirty();
+		}
+
+		// let the gpu catch up so the timing covers every frame we submitted (and so nothing is in use when we start destroying things)
+		vkDeviceWaitIdle(tvDevice.device());
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		if (framesDrawn > 0 && seconds > 0.0)
+		{
+			std::cout << framesDrawn << " frames at " << tvSwapChain->width() << "x" << tvSwapChain->height()
+				<< " in " << seconds << "s (" << framesDrawn / seconds << " frames/sec)" << std::endl;
+		}
+
+		reportFrameStats();
+		tvDevice.allocator().printStats(std::cout);
+		tvDevice.shaderModules().printStats(std::cout);
+		tvDevice.layouts().printStats(std::cout);
+		pipelines.printStats(std::cout);
+		if (pipelineLibrary != nullptr)
+		{
+			pipelineLibrary->printStats(std::cout);
 		}
 	}
 
-	void FirstApp::createPipelineLayout()
+	void FirstApp::reportFrameStats()
 	{
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		// everything has finished by now, so every frame's last timestamps are readable
+		for (uint32_t i = 0; i < slotFrames.size(); i++)
+		{
+			collectFrameResults(i);
+		}
 
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 0;
-		pipelineLayoutInfo.pSetLayouts = nullptr;
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-		pipelineLayoutInfo.pPushConstantRanges = nullptr;
+		frameStats.printSummary(std::cout);
+		if (!options.statsCsvPath.empty())
+		{
+			frameStats.writeCsv(options.statsCsvPath);
+			std::cout << "wrote frame stats to " << options.statsCsvPath << std::endl;
+		}
+		if (!options.statsJsonPath.empty())
+		{
+			frameStats.writeJson(options.statsJsonPath);
+			std::cout << "wrote frame stats to " << options.statsJsonPath << std::endl;
+		}
+	}
 
-		if (vkCreatePipelineLayout(tvDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	void FirstApp::loadShaders()
+	{
+		if (options.shaderBundlePath.empty() || !std::filesystem::exists(options.shaderBundlePath))
 		{
-			throw std::runtime_error("failed to create pipeline layout");
+			std::cout << "no shader bundle, loading loose .spv files" << std::endl;
+			return;
 		}
+		auto bundle = std::make_shared<TvShaderBundle>(options.shaderBundlePath);
+		std::cout << "mounted " << bundle->stageCount() << " shaders from " << bundle->path() << std::endl;
+		tvDevice.shaderModules().mount(std::move(bundle));
+	}
+
+	void FirstApp::loadModels()
+	{
+		// the per object and instanced paths only draw the triangle, gpu driven draws go through all three
+		std::vector<TvModel::Mesh> meshes(3);
+		meshes[0].vertices = {
+			{ { 0.0f, -0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+			{ { -0.5f, 0.5f, 0.0f }, { 0.0f, 1.0f, 0.0f } },
+			{ { 0.5f, 0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } } };
+		meshes[1].vertices = {
+			{ { -0.4f, -0.4f, 0.0f }, { 1.0f, 1.0f, 0.0f } },
+			{ { 0.4f, -0.4f, 0.0f }, { 0.0f, 1.0f, 1.0f } },
+			{ { -0.4f, 0.4f, 0.0f }, { 1.0f, 0.0f, 1.0f } },
+			{ { 0.4f, 0.4f, 0.0f }, { 1.0f, 1.0f, 1.0f } } };
+		meshes[1].indices = { 0, 1, 2, 2, 1, 3 };
+		meshes[2].vertices = {
+			{ { 0.0f, -0.5f, 0.0f }, { 1.0f, 0.5f, 0.0f } },
+			{ { -0.35f, 0.0f, 0.0f }, { 0.5f, 1.0f, 0.0f } },
+			{ { 0.35f, 0.0f, 0.0f }, { 0.0f, 0.5f, 1.0f } },
+			{ { 0.0f, 0.5f, 0.0f }, { 1.0f, 0.0f, 0.5f } } };
+		meshes[2].indices = { 0, 1, 2, 2, 1, 3 };
+		model = std::make_unique<TvModel>(tvDevice, uploads, meshes, options.vertexLayout);
+		std::cout << "model: " << model->meshCount() << " meshes, " << model->getVertexCount() << " vertices, "
+			<< TvModel::layoutName(model->vertexLayout()) << " layout, " << model->memorySize() << " bytes" << std::endl;
+
+		if (options.gpuDriven && options.drawCount > 0 && !tvDevice.supportsMultiDrawIndirect())
+		{
+			std::cout << "no multi draw indirect on this device, drawing per object instead" << std::endl;
+		}
+		else if (options.gpuDriven && options.drawCount > 0)
+		{
+			std::vector<TvIndirectDrawList::Object> objects(options.drawCount);
+			const uint32_t columns = gridColumns(options.drawCount);
+			for (uint32_t i = 0; i < options.drawCount; i++)
+			{
+				objects[i].mesh = i % model->meshCount();
+				objects[i].instance = gridInstance(i, columns);
+			}
+			// occlusion culling has nothing to do on a flat grid, so push it back and put occluders in front of it
+			if (options.occlusion)
+			{
+				for (TvIndirectDrawList::Object& object : objects)
+				{
+					object.instance.depth = GRID_DEPTH;
+				}
+				for (uint32_t i = 0; i < OCCLUDER_COUNT; i++)
+				{
+					objects.push_back({ 1, occluderInstance(i) });
+				}
+			}
+			drawList = std::make_unique<TvIndirectDrawList>(tvDevice, uploads, *model, objects);
+			std::cout << "gpu driven: " << drawList->objectCount() << " objects, " << drawList->memorySize() << " bytes, "
+				<< (tvDevice.supportsDrawIndirectCount() ? "indirect count" : "multi draw indirect") << std::endl;
+			if (options.cull || options.occlusion)
+			{
+				culling = std::make_unique<TvCullingPass>(tvDevice, *drawList, frameTimeline.framesInFlight(), options.occlusion,
+					pipelineCache.cache());
+				std::cout << "culling: " << (culling->hasOcclusion() ? "frustum + two phase occlusion" : "frustum") << ", "
+					<< (culling->isCompacting() ? "compacted" : "zeroed instance counts") << ", " << culling->memorySize() << " bytes" << std::endl;
+			}
+		}
+		else if (options.instanced && options.drawCount > 0)
+		{
+			instances = std::make_unique<TvInstanceBuffer>(tvDevice, frameTimeline.framesInFlight(), options.drawCount);
+			std::cout << "instancing: " << instances->capacity() << " instances, " << instances->memorySize() << " bytes of "
+				<< (instances->isDeviceLocal() ? "device local" : "host") << " memory" << std::endl;
+		}
+		modelUpload = uploads.flush();
+	}
+
+	void FirstApp::createPipelineLayout()
+	{
+		// no descriptor sets yet, just the per draw push constants (the device owns the layout)
+		PipelineLayoutDesc layoutDesc;
+		layoutDesc.addPushConstants<SimplePushConstantData>(VK_SHADER_STAGE_VERTEX_BIT);
+		pipelineLayout = tvDevice.layouts().get(layoutDesc);
 	}
 
 	void FirstApp::createPipeline()
 	{
-		PipelineConfigInfo pipelineConfig{};
-		TvPipeline::defaultPipelineConfigInfo(
-			pipelineConfig,
-			tvSwapChain.width(),
-			tvSwapChain.height());
-		pipelineConfig.renderPass = tvSwapChain.getRenderPass();
-		pipelineConfig.pipelineLayout = pipelineLayout;
-		tvPipeline = std::make_unique<TvPipeline>(tvDevice, "simple_shader.vert.spv", "simple_shader.frag.spv", pipelineConfig);
+		// same fragment shader either way, the instanced vertex shader reads the per draw data from the instance buffer
+		// (or the draw list's object buffer, which looks the same)
+		const bool instanced = instances != nullptr || drawList != nullptr;
+		pipelineKey.program = pipelines.program(instanced ? "instanced_shader.vert.spv" : "simple_shader.vert.spv", "simple_shader.frag.spv");
+		pipelineKey.renderPass = tvSwapChain->getRenderPass();
+		pipelineKey.pipelineLayout = pipelineLayout;
+		pipelineKey.extendedDynamicState = tvDevice.supportsExtendedDynamicState();
+		pipelineKey.vertexLayout = static_cast<uint8_t>(model->vertexLayout());
+		pipelineKey.instanced = instanced;
+
+		pipelineRequested = std::chrono::steady_clock::now();
+		pipelines.get(pipelineKey);
+	}
+
+	TvPipeline* FirstApp::currentPipeline()
+	{
+		// asked every frame (it's a hash lookup), that's how a reloaded pipeline gets swapped in once it's built
+		std::shared_ptr<TvPipeline> pipeline = TvPipelineCompiler::ready(pipelines.poll(pipelineKey));
+		if (pipeline != nullptr && tvPipeline == nullptr)
+		{
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineRequested).count();
+			std::cout << "pipeline ready " << std::fixed << std::setprecision(2) << ms << std::defaultfloat << "ms after it was requested ("
+				<< (pipelineCache.isWarm() ? "warm" : "cold") << " cache)" << std::endl;
+		}
+		else if (pipeline != nullptr && pipeline != tvPipeline)
+		{
+			bool optimized = tvPipeline->isFastLinked() && !pipeline->isFastLinked();
+			std::cout << (optimized ? "swapped in optimized pipeline" : "swapped in reloaded pipeline") << std::endl;
+		}
+		tvPipeline = std::move(pipeline);
+
+		// whatever got replaced might still be in use by frames in flight
+		for (PipelineFuture& oldPipeline : pipelines.takeRetired())
+		{
+			frameTimeline.deferUntilRetired([oldPipeline]() {});
+		}
+		return tvPipeline.get();
+	}
+
+	void FirstApp::reloadChangedShaders()
+	{
+		if (shaderWatcher == nullptr)
+		{
+			return;
+		}
+		for (const std::string& spvPath : shaderWatcher->takeRebuilt())
+		{
+			// the bundle still has the old code, the file is the new one
+			tvDevice.shaderModules().preferFile(spvPath);
+			uint32_t count = pipelines.reload(spvPath);
+			std::cout << "rebuilding " << count << " pipeline" << (count == 1 ? "" : "s") << " using " << spvPath << std::endl;
+		}
+	}
+
+	void FirstApp::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	{
+		// it only gets submitted once before the pool is reset, which lets the driver skip some bookkeeping
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording command buffer");
+		}
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = tvSwapChain->getRenderPass();
+		renderPassInfo.framebuffer = tvSwapChain->getFrameBuffer(imageIndex, frameTimeline.frameIndex());
+
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = tvSwapChain->getSwapChainExtent();
+
+		// default values assigned to the buffer - index 0 is the color buffer, index 1 is the depth buffer
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = { 0.1f, 0.1f, 0.1f, 1.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		// nothing gets drawn until the pipeline has compiled and the model is on the gpu, the frame still goes out (just cleared)
+		const bool ready = currentPipeline() != nullptr && uploads.isComplete(modelUpload);
+		const uint32_t drawCount = ready ? options.drawCount : 0;
+
+		// timestamps go around the whole render pass (they can't be reset inside one)
+		const uint32_t frameIndex = frameTimeline.frameIndex();
+		gpuTimer.writeBegin(commandBuffer, frameIndex);
+		if (instances != nullptr)
+		{
+			writeInstances(frameIndex, drawCount);
+		}
+		// compute has to happen outside the render pass, the draws wait on it with the barriers it records
+		const glm::mat4 cullViewProjection = viewProjection(viewTransform(options.zoom));
+		const bool occlusionCulling = depthPyramid != nullptr && drawCount > 0;
+		if (occlusionCulling)
+		{
+			// the first phase tests against last frame's depth, if this swapchain has drawn a frame yet
+			if (frameTimeline.currentFrame() > firstDepthFrame)
+			{
+				depthPyramid->build(commandBuffer, static_cast<uint32_t>((frameTimeline.currentFrame() - 1) % frameTimeline.framesInFlight()));
+			}
+			else
+			{
+				depthPyramid->clear(commandBuffer);
+			}
+		}
+		if (culling != nullptr && drawCount > 0)
+		{
+			culling->record(commandBuffer, frameIndex, cullViewProjection, TvCullingPass::Phase::First, depthPyramid.get());
+		}
+
+		// a gpu driven frame is one indirect draw, nothing to split up
+		if (recordWorkers.size() == 0 || drawList != nullptr)
+		{
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			recordDraws(commandBuffer, 0, drawCount);
+		}
+		else
+		{
+			// one slice of the draw list per worker, each recorded into a secondary from that worker's own pool
+			// the primary just begins the pass and executes them in order, so the result is the same as recording inline
+			const uint32_t sliceCount = std::max(std::min(recordWorkers.size(), drawCount), 1u);
+			secondaryBuffers.assign(sliceCount, VK_NULL_HANDLE);
+
+			VkCommandBufferInheritanceInfo inheritanceInfo{};
+			inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritanceInfo.renderPass = renderPassInfo.renderPass;
+			inheritanceInfo.subpass = 0;
+			inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
+
+			recordWorkers.parallelFor(sliceCount, [&](uint32_t slice, uint32_t worker)
+			{
+				VkCommandBuffer secondary = commandPools.allocateSecondary(worker);
+
+				VkCommandBufferBeginInfo secondaryBeginInfo{};
+				secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+				secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+				if (vkBeginCommandBuffer(secondary, &secondaryBeginInfo) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to begin recording secondary command buffer");
+				}
+				uint32_t firstDraw = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * slice / sliceCount);
+				uint32_t endDraw = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * (slice + 1) / sliceCount);
+				recordDraws(secondary, firstDraw, endDraw);
+				if (vkEndCommandBuffer(secondary) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to record secondary command buffer");
+				}
+				secondaryBuffers[slice] = secondary;
+			});
+
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			vkCmdExecuteCommands(commandBuffer, sliceCount, secondaryBuffers.data());
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		if (occlusionCulling)
+		{
+			// the second phase tests what the first one hid against the depth the first one drew, and draws whatever
+			// turned out to be in view on top of it
+			depthPyramid->build(commandBuffer, frameIndex);
+			culling->record(commandBuffer, frameIndex, cullViewProjection, TvCullingPass::Phase::Second, depthPyramid.get());
+
+			renderPassInfo.renderPass = tvSwapChain->getLoadRenderPass();
+			renderPassInfo.clearValueCount = 0;
+			renderPassInfo.pClearValues = nullptr;
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			recordDraws(commandBuffer, 0, drawCount, TvCullingPass::Phase::Second);
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		gpuTimer.writeEnd(commandBuffer, frameIndex);
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record command buffer");
+		}
+	}
+
+	void FirstApp::recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t endDraw, TvCullingPass::Phase phase)
+	{
+		if (firstDraw == endDraw)
+		{
+			return;
+		}
+		// secondaries don't inherit the bound pipeline or dynamic state, so every slice sets its own
+		tvPipeline->Bind(commandBuffer);
+		tvPipeline->setViewport(commandBuffer, tvSwapChain->getSwapChainExtent());
+		tvPipeline->setRenderState(commandBuffer, renderState);
+		const SimplePushConstantData view = viewTransform(options.zoom);
+		if (drawList != nullptr)
+		{
+			// the instanced shader takes the view as push constants
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(SimplePushConstantData), &view);
+			if (culling != nullptr)
+			{
+				culling->draw(commandBuffer, frameTimeline.frameIndex(), phase);
+			}
+			else
+			{
+				drawList->bind(commandBuffer);
+				drawList->draw(commandBuffer);
+			}
+			return;
+		}
+
+		model->bind(commandBuffer);
+		if (instances != nullptr)
+		{
+			// the whole slice is one draw, the instance index picks its data (written before recording started)
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(SimplePushConstantData), &view);
+			instances->bind(commandBuffer, frameTimeline.frameIndex());
+			model->draw(commandBuffer, endDraw - firstDraw, firstDraw);
+			return;
+		}
+
+		const uint32_t columns = gridColumns(options.drawCount);
+		for (uint32_t i = firstDraw; i < endDraw; i++)
+		{
+			TvInstanceBuffer::InstanceData instance = gridInstance(i, columns);
+			SimplePushConstantData push{};
+			push.transform = view.transform * instance.transform;
+			push.offset = view.transform * instance.offset + view.offset;
+			push.color = instance.color;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(SimplePushConstantData), &push);
+			model->draw(commandBuffer);
+		}
 	}
 
-	void FirstApp::createCommandBuffers() 
+	void FirstApp::writeInstances(uint32_t frameIndex, uint32_t drawCount)
 	{
-		commandBuffers.resize(tvSwapChain.imageCount());
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = tvDevice.getCommandPool();
-		allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+		// straight into mapped (coherent) memory, nothing to flush or copy. this frame index's last frame has retired
+		// by the time it's acquired, so the gpu isn't reading this region anymore
+		TvInstanceBuffer::InstanceData* frameInstances = instances->frameInstances(frameIndex);
+		const uint32_t columns = gridColumns(options.drawCount);
+		for (uint32_t i = 0; i < drawCount; i++)
+		{
+			frameInstances[i] = gridInstance(i, columns);
+		}
+	}
 
-		if (vkAllocateCommandBuffers(tvDevice.device(), &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+	void FirstApp::recreateSwapChain()
+	{
+		auto extent = tvWindow.getExtent();
+		// a minimized window has a 0x0 framebuffer, there's nothing to draw to until it comes back
+		while (extent.width == 0 || extent.height == 0)
 		{
-			throw std::runtime_error("failed to allocate command buffers");
+			glfwWaitEvents();
+			extent = tvWindow.getExtent();
 		}
 
-		// record the render pass to the command buffers
-		// these are identical passes but each command buffer is assigned to its own framebuffer
-		for (int i = 0; i < commandBuffers.size(); i++)
+		if (tvSwapChain == nullptr)
 		{
-			VkCommandBufferBeginInfo beginInfo{};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			// the occlusion culling builds its depth pyramid from the depth attachments
+			const bool sampledDepth = culling != nullptr && culling->hasOcclusion();
+			tvSwapChain = std::make_unique<TvSwapChain>(tvDevice, frameTimeline, extent, options.presentPolicy, sampledDepth);
+			reportDepthMemory();
+		}
+		else
+		{
+			// no vkDeviceWaitIdle here: the old swapchain gets retired and the frames still using it (and the
+			// pipeline they were recorded with) are freed by the frame timeline once they finish
+			std::shared_ptr<TvSwapChain> oldSwapChain = std::move(tvSwapChain);
+			tvSwapChain = std::make_unique<TvSwapChain>(tvDevice, frameTimeline, extent, oldSwapChain);
 
-			if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS)
+			// the viewport is dynamic so a new size keeps the pipeline, it only has to go if the render pass
+			// didn't carry over (the old swapchain still has its own when the formats changed)
+			if (oldSwapChain->getRenderPass() != VK_NULL_HANDLE)
 			{
-				throw std::runtime_error("failed to begin recording command buffer");
+				// every pipeline made for the old render pass goes with it, once the frames using them retire
+				// (and a compile that's still going uses the old render pass too, so that has to finish first)
+				std::vector<PipelineFuture> oldPipelines = pipelines.evict(oldSwapChain->getRenderPass());
+				for (auto& oldPipeline : oldPipelines)
+				{
+					oldPipeline.wait();
+				}
+				tvPipeline = nullptr;
+				frameTimeline.deferUntilRetired([oldPipelines]() {});
 			}
+		}
 
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = tvSwapChain.getRenderPass();
-			renderPassInfo.framebuffer = tvSwapChain.getFrameBuffer(i);
+		if (tvSwapChain->isDepthSampled())
+		{
+			// sized for (and reading the depth of) the new swapchain, the old one goes once the frames that used it retire
+			if (depthPyramid != nullptr)
+			{
+				std::shared_ptr<TvDepthPyramid> oldPyramid = std::move(depthPyramid);
+				frameTimeline.deferUntilRetired([oldPyramid]() {});
+			}
+			depthPyramid = std::make_unique<TvDepthPyramid>(tvDevice, *tvSwapChain, pipelineCache.cache());
+			firstDepthFrame = frameTimeline.currentFrame();
+		}
 
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = tvSwapChain.getSwapChainExtent();
+		// (asking for the same key again while it's still compiling is just a lookup)
+		if (tvPipeline == nullptr)
+		{
+			createPipeline();
+		}
+		updateFrameLimiter();
+	}
 
-			// default values assigned to the buffer - index 0 is the color buffer, index 1 is the depth buffer
-			std::array<VkClearValue, 2> clearValues{};
-			clearValues[0].color = { 0.1f, 0.1f, 0.1f, 1.0f };
-			clearValues[1].depthStencil = { 1.0f, 0 };
-			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+	void FirstApp::reportDepthMemory()
+	{
+		const DepthMemoryStats& depth = tvSwapChain->depthMemoryStats();
+		const double mb = 1024.0 * 1024.0;
+		std::cout << std::fixed << std::setprecision(1) << "depth: " << depth.imageCount << (depth.sampled ? " sampled" : " transient") << " images, "
+			<< depth.bytes / mb << " MB" << (depth.lazilyAllocated ? " lazily allocated" : "")
+			<< " (" << (depth.perSwapChainImageBytes - std::min(depth.bytes, depth.perSwapChainImageBytes)) / mb
+			<< " MB less than one per swapchain image)" << std::defaultfloat << std::endl;
+	}
 
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	void FirstApp::updateFrameLimiter()
+	{
+		double target = options.fpsLimit;
+		if (target < 0.0)
+		{
+			// fifo modes are already held to the refresh rate by present, the others would happily do thousands of frames
+			// (headless runs are benchmarks, let them go flat out)
+			int refreshRate = tvWindow.getRefreshRate();
+			target = tvSwapChain->isPresentUnthrottled() && refreshRate > 0 ? static_cast<double>(refreshRate) : 0.0;
+		}
 
-			tvPipeline->Bind(commandBuffers[i]);
-			vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);	// hardcoded tri in the shader
+		frameLimiter.setTarget(target);
 
-			vkCmdEndRenderPass(commandBuffers[i]);
-			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+		// only worth mentioning when it changes, not on every resize
+		VkPresentModeKHR presentMode = tvSwapChain->getPresentMode();
+		if (presentMode != lastPresentMode && !tvWindow.isHeadless())
+		{
+			std::cout << "present mode: " << TvSwapChain::presentModeName(presentMode);
+			if (frameLimiter.isEnabled())
 			{
-				throw std::runtime_error("failed to record command buffer");
+				std::cout << ", limited to " << frameLimiter.target() << " fps";
 			}
+			std::cout << std::endl;
 		}
+		lastPresentMode = presentMode;
 	}
+
 	void FirstApp::drawFrame() 
 	{
+		// hold off before acquiring/recording anything, so the frame we do draw is as fresh as it can be
+		double limiterMs = frameLimiter.wait();
+		// a frame boundary, so a good time to kick off rebuilds for shaders that changed
+		reloadChangedShaders();
+
+		auto frameStart = std::chrono::steady_clock::now();
 		uint32_t imageIndex;
-		auto result = tvSwapChain.acquireNextImage(&imageIndex);
+		auto result = tvSwapChain->acquireNextImage(&imageIndex);
+
+		// the swapchain no longer matches the window (usually a resize), nothing we can draw into this frame
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			recreateSwapChain();
+			return;
+		}
 
 		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
 		{
 			throw std::runtime_error("failed to acquire swapchain image");
 		}
 
-		result = tvSwapChain.submitCommandBuffers(&commandBuffers[imageIndex], &imageIndex);
-		if (result != VK_SUCCESS)
+		// acquiring waited for this frame index to retire, so its pool can be reset and its timestamps read
+		// (the command buffer we're about to record resets those queries, so read them first)
+		const uint32_t frameIndex = frameTimeline.frameIndex();
+		collectFrameResults(frameIndex);
+		commandPools.beginFrame(frameIndex);
+		VkCommandBuffer commandBuffer = commandPools.allocatePrimary();
+		auto recordStart = std::chrono::steady_clock::now();
+		recordCommandBuffer(commandBuffer, imageIndex);
+		double recordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+
+		result = tvSwapChain->submitCommandBuffers(&commandBuffer, &imageIndex);
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR)
 		{
 			throw std::runtime_error("failed to present swapchain image");
 		}
+
+		const SwapChainTimings& timings = tvSwapChain->lastTimings();
+		FrameRecord& record = frameStats.beginFrame(frameNumber);
+		record.limiterMs = limiterMs;
+		record.frameWaitMs = timings.frameWaitMs;
+		record.acquireMs = timings.acquireMs;
+		record.imageWaitMs = timings.imageWaitMs;
+		record.submitMs = timings.submitMs;
+		record.presentMs = timings.presentMs;
+		record.recordMs = recordMs;
+		record.cpuFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+
+		slotFrames[frameIndex] = frameNumber;
+		frameNumber++;
+
+		// the frame still went out, but the swapchain needs rebuilding before the next one
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || tvWindow.wasWindowResized())
+		{
+			tvWindow.resetWindowResizedFlag();
+			recreateSwapChain();
+		}
+	}
+
+	void FirstApp::collectFrameResults(uint32_t frameIndex)
+	{
+		if (slotFrames[frameIndex] == NO_FRAME)
+		{
+			return;
+		}
+
+		// the frame has retired by the time we get here, so this should never miss, but it doesn't block if it does
+		FrameRecord* record = frameStats.find(slotFrames[frameIndex]);
+		double gpuMs;
+		if (gpuTimer.read(frameIndex, gpuMs) && record != nullptr)
+		{
+			record->gpuMs = gpuMs;
+		}
+		CullStats cullStats;
+		if (culling != nullptr && culling->readStats(frameIndex, cullStats) && record != nullptr)
+		{
+			record->objectsTested = cullStats.tested;
+			record->objectsCulled = cullStats.culled();
+			record->objectsDrawn = cullStats.drawn;
+		}
+		slotFrames[frameIndex] = NO_FRAME;
 	}
 }
\ No newline at end of file
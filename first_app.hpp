@@ -2,44 +2,185 @@
 
 #include "tv_window.hpp"
 #include "tv_pipeline.hpp"
+#include "tv_pipeline_cache.hpp"
+#include "tv_pipeline_compiler.hpp"
+#include "tv_pipeline_library.hpp"
+#include "tv_pipeline_table.hpp"
+#include "tv_shader_watcher.hpp"
 #include "tv_device.hpp"
 #include "tv_swap_chain.hpp"
+#include "tv_frame_timeline.hpp"
+#include "tv_frame_command_pools.hpp"
+#include "tv_frame_stats.hpp"
+#include "tv_thread_pool.hpp"
+#include "tv_frame_limiter.hpp"
+#include "tv_upload_manager.hpp"
+#include "tv_model.hpp"
+#include "tv_instance_buffer.hpp"
+#include "tv_indirect_draw_list.hpp"
+#include "tv_culling_pass.hpp"
+#include "tv_depth_pyramid.hpp"
 
 // std
+#include <chrono>
+#include <limits>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace tv
 {
+	// Things you can pick from the command line (see main.cpp)
+	struct AppOptions
+	{
+		// render into offscreen images instead of a window, for CI/render farm boxes with no display
+		bool headless = false;
+		uint32_t width = 800;
+		uint32_t height = 600;
+		// how many frames to draw before Run returns, 0 means keep going until the window closes
+		uint32_t frameCount = 0;
+		// how many frames the cpu may get ahead of the gpu (1-3), more is smoother but adds latency
+		uint32_t framesInFlight = 2;
+		PresentPolicy presentPolicy = PresentPolicy::LowLatency;
+		// caps the frame rate on the cpu side, 0 means no cap and negative means cap at the monitor's refresh rate
+		// but only when the present mode doesn't already (mailbox/immediate)
+		double fpsLimit = -1.0;
+		// how many times the triangle gets drawn per frame, a stand-in for a real draw list until we have one
+		uint32_t drawCount = 1;
+		// worker threads recording secondary command buffers, 0 records everything inline on the main thread
+		uint32_t recordThreads = 0;
+		// threads compiling pipelines in the background, 0 compiles them on the main thread before the first frame
+		uint32_t compileThreads = 2;
+		// where to dump the per-frame timing records on exit, empty means don't
+		std::string statsCsvPath;
+		std::string statsJsonPath;
+		// compiled pipelines are kept here between runs so startup (and swapchain recreation) skips the shader compile
+		std::string pipelineCachePath = "pipeline_cache.bin";
+		// packed shaders (see TvShaderBundle), loose .spv files are used if it doesn't exist
+		std::string shaderBundlePath = "shaders.tvsb";
+		// recompile the GLSL when it changes and swap the new pipelines in as soon as they're built
+		bool hotReload = false;
+		// link pipelines from separately compiled parts when the device supports it (VK_EXT_graphics_pipeline_library),
+		// so a new state combination is usable right away and gets optimized in the background
+		bool pipelineLibrary = true;
+		// interleaved vertices, or positions in their own stream (Split)
+		VertexLayout vertexLayout = VertexLayout::Interleaved;
+		// draw the whole draw list with instanced draws (per instance data in a vertex buffer) instead of one draw and
+		// one set of push constants per object
+		bool instanced = false;
+		// keep the draw list on the gpu and draw all of it with one indirect call, so recording doesn't grow with the
+		// draw count (needs multi draw indirect, falls back to per object draws without it). wins over instanced
+		bool gpuDriven = false;
+		// frustum cull the gpu driven draw list in a compute pass first (does nothing without gpuDriven)
+		bool cull = false;
+		// cull against a depth pyramid as well, in two phases (see TvCullingPass), turns on cull. the grid goes behind a
+		// few big quads so there's something to hide
+		bool occlusion = false;
+		// scales the view around the center of the screen, above 1 pushes the edges of the grid off screen
+		float zoom = 1.0f;
+	};
+
 	// This app class contains the width and height data of the window, the run function, and three engine references
 	class FirstApp
 	{
 	public:
-		static constexpr int WIDTH = 800;
-		static constexpr int HEIGHT = 600;
-
-		FirstApp();
+		FirstApp(const AppOptions& options = AppOptions{});
 		~FirstApp();
 
 		FirstApp(const FirstApp&) = delete;
 		FirstApp& operator = (const FirstApp&) = delete;
 
 		void Run();
+		const TvFrameStats& stats() const { return frameStats; }
 	private:
+		// mounts the shader bundle if there is one
+		void loadShaders();
+		// creates the models (and the gpu draw list) and starts their uploads
+		void loadModels();
 		void createPipelineLayout();
+		// asks the pipeline table for our pipeline (queueing it up on the compiler if it's new), draws are skipped until it's ready
 		void createPipeline();
-		void createCommandBuffers();
+		// the pipeline if it has finished compiling, nullptr if not (picks up reloaded pipelines too)
+		TvPipeline* currentPipeline();
+		// starts rebuilding the pipelines for any shader the watcher recompiled
+		void reloadChangedShaders();
+		// records this frame's commands, from scratch every frame
+		void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+		// records draws [firstDraw, endDraw) of the draw list, inside the render pass (a culled gpu driven draw list draws
+		// whatever the culling left for the phase instead)
+		void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t endDraw,
+			TvCullingPass::Phase phase = TvCullingPass::Phase::First);
+		// fills in this frame's instance data for the first drawCount draws (instanced only)
+		void writeInstances(uint32_t frameIndex, uint32_t drawCount);
 		void drawFrame();
+		// (re)creates the swapchain at the current window size along with everything that depends on it
+		void recreateSwapChain();
+		// how much memory the depth attachments take (printed once at startup)
+		void reportDepthMemory();
+		// picks the limiter target for the present mode we got (see AppOptions::fpsLimit)
+		void updateFrameLimiter();
+		// grabs the gpu time (and culling stats) of the last frame that used this frame index, if the gpu has finished it
+		void collectFrameResults(uint32_t frameIndex);
+		void reportFrameStats();
 
+		AppOptions options;
 		// The window object is what gets initially created and drawn to
-		TvWindow tvWindow{ WIDTH, HEIGHT, "Hello Vulkan" };
+		TvWindow tvWindow;
 		// the device object contains the logical object(?) of the drawing device, the gpu
 		TvDevice tvDevice{ tvWindow };
+		// everything that puts data in device local memory goes through here (staging ring + transfer queue)
+		TvUploadManager uploads{ tvDevice };
+		// every pipeline gets created through this, it's loaded from disk at startup and written back now and then
+		TvPipelineCache pipelineCache{ tvDevice, options.pipelineCachePath };
+		// counts submitted/finished frames on one timeline semaphore, everything that needs to know
+		// "is the gpu done with this yet" asks it (declared before anything that defers cleanup to it)
+		TvFrameTimeline frameTimeline{ tvDevice, options.framesInFlight };
 		// the swapchain provides info on the buffering process/how the frame is presented
-		TvSwapChain tvSwapChain{ tvDevice, tvWindow.getExtent() };
+		// (a pointer since it gets replaced whenever the window is resized)
+		std::unique_ptr<TvSwapChain> tvSwapChain;
+		TvFrameLimiter frameLimiter;
+		VkPresentModeKHR lastPresentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
 		// the pipeline contains the information regarding how the engine renders, such as the vert and frag shaders and the layout of the pipeline itself
-		std::unique_ptr<TvPipeline> tvPipeline;
+		// (pipelines come from the table by key and compile in the background, tvPipeline stays null until ours is done)
+		TvPipelineCompiler pipelineCompiler{ tvDevice, pipelineCache, options.compileThreads };
+		// null when the device (or options) say no, then every pipeline is compiled whole
+		std::unique_ptr<TvPipelineLibrary> pipelineLibrary{ options.pipelineLibrary && tvDevice.supportsGraphicsPipelineLibrary()
+			? std::make_unique<TvPipelineLibrary>(tvDevice, pipelineCache) : nullptr };
+		TvPipelineTable pipelines{ pipelineCompiler, pipelineLibrary.get() };
+		PipelineKey pipelineKey;
+		std::chrono::steady_clock::time_point pipelineRequested;
+		std::shared_ptr<TvPipeline> tvPipeline;
+		// only with hotReload
+		std::unique_ptr<TvShaderWatcher> shaderWatcher;
+		// cull/depth/topology for the draws, only takes effect with extended dynamic state (otherwise the config's are baked in)
+		DynamicRenderState renderState;
+		// from the device's layout cache (which destroys it)
 		VkPipelineLayout pipelineLayout;
-		std::vector<VkCommandBuffer> commandBuffers;
+		// drawn once the upload with this token has finished (skipped until then, like the pipeline)
+		std::unique_ptr<TvModel> model;
+		TvUploadManager::Token modelUpload = 0;
+		// one InstanceData per draw, rewritten every frame (only with options.instanced)
+		std::unique_ptr<TvInstanceBuffer> instances;
+		// the whole draw list, uploaded once with the model (only with options.gpuDriven)
+		std::unique_ptr<TvIndirectDrawList> drawList;
+		// culls drawList every frame before it's drawn (only with options.cull)
+		std::unique_ptr<TvCullingPass> culling;
+		// what the occlusion culling tests against, made for (and replaced with) the swapchain (only with options.occlusion)
+		std::unique_ptr<TvDepthPyramid> depthPyramid;
+		// the first frame drawn with the current swapchain, the frames before it left no depth the pyramid can use
+		uint64_t firstDepthFrame = 0;
+		// splits the draw list across threads that each record a secondary command buffer (none if recordThreads is 0)
+		TvThreadPool recordWorkers{ options.recordThreads };
+		// where each frame's command buffers come from, one pool per frame in flight (and per worker)
+		TvFrameCommandPools commandPools{ tvDevice, frameTimeline.framesInFlight(), options.recordThreads };
+		std::vector<VkCommandBuffer> secondaryBuffers;
+
+		// per-frame cpu/gpu timings, gpu timestamps are written by each frame's command buffer (one timer slot per frame in flight)
+		static constexpr uint64_t NO_FRAME = std::numeric_limits<uint64_t>::max();
+		TvFrameStats frameStats;
+		TvGpuTimer gpuTimer{ tvDevice, frameTimeline.framesInFlight() };
+		// which frame last used each frame index (so we know who its timestamps belong to)
+		std::vector<uint64_t> slotFrames = std::vector<uint64_t>(frameTimeline.framesInFlight(), NO_FRAME);
+		uint64_t frameNumber = 0;
 	};
 }
\ No newline at end of file
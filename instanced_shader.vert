@@ -0,0 +1,30 @@
+#version 450
+
+// from the model's vertex buffer (TvModel::Vertex), binding 0 or two streams depending on the layout
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+
+// per instance, from TvInstanceBuffer::InstanceData (binding 2)
+layout(location = 2) in vec2 instanceTransformColumn0;
+layout(location = 3) in vec2 instanceTransformColumn1;
+layout(location = 4) in vec2 instanceOffset;
+layout(location = 5) in vec3 instanceColor;
+layout(location = 6) in float instanceDepth;
+
+layout(location = 0) out vec3 fragColor;
+
+// the view, applied after the instance's transform (same block as simple_shader.vert so they share a layout)
+layout(push_constant) uniform Push
+{
+	mat2 transform;
+	vec2 offset;
+	vec3 color;
+} push;
+
+void main()
+{
+	mat2 transform = mat2(instanceTransformColumn0, instanceTransformColumn1);
+	vec2 world = transform * position.xy + instanceOffset;
+	gl_Position = vec4(push.transform * world + push.offset, position.z + instanceDepth, 1.0);
+	fragColor = color * instanceColor * push.color;
+}
\ No newline at end of file
@@ -1,12 +1,359 @@
 #include "first_app.hpp"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <stdexcept>
+#include <iomanip>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
-int main()
+namespace
 {
-	tv::FirstApp app;
+	// pulls the number after a flag like --frames 500, complains if there isn't one
+	std::string parseString(int argc, char** argv, int& i)
+	{
+		if (i + 1 >= argc)
+		{
+			throw std::invalid_argument(std::string("missing value for ") + argv[i]);
+		}
+		return argv[++i];
+	}
+
+	uint32_t parseCount(int argc, char** argv, int& i)
+	{
+		return static_cast<uint32_t>(std::stoul(parseString(argc, argv, i)));
+	}
+
+	tv::PresentPolicy parsePresentPolicy(const std::string& name)
+	{
+		if (name == "low-latency") return tv::PresentPolicy::LowLatency;
+		if (name == "power-saving") return tv::PresentPolicy::PowerSaving;
+		if (name == "vsync") return tv::PresentPolicy::Vsync;
+		if (name == "relaxed") return tv::PresentPolicy::Relaxed;
+		throw std::invalid_argument("unknown present policy: " + name);
+	}
+
+	tv::VertexLayout parseVertexLayout(const std::string& name)
+	{
+		if (name == "interleaved") return tv::VertexLayout::Interleaved;
+		if (name == "split") return tv::VertexLayout::Split;
+		throw std::invalid_argument("unknown vertex layout: " + name);
+	}
+
+	tv::AppOptions parseOptions(int argc, char** argv, bool& benchRecord, bool& benchInstancing)
+	{
+		tv::AppOptions options{};
+		for (int i = 1; i < argc; i++)
+		{
+			if (std::strcmp(argv[i], "--headless") == 0)
+			{
+				options.headless = true;
+			}
+			else if (std::strcmp(argv[i], "--frames") == 0)
+			{
+				options.frameCount = parseCount(argc, argv, i);
+			}
+			else if (std::strcmp(argv[i], "--width") == 0)
+			{
+				options.width = parseCount(argc, argv, i);
+				if (options.width == 0)
+				{
+					throw std::invalid_argument("--width has to be at least 1");
+				}
+			}
+			else if (std::strcmp(argv[i], "--height") == 0)
+			{
+				options.height = parseCount(argc, argv, i);
+				if (options.height == 0)
+				{
+					throw std::invalid_argument("--height has to be at least 1");
+				}
+			}
+			else if (std::strcmp(argv[i], "--frames-in-flight") == 0)
+			{
+				options.framesInFlight = parseCount(argc, argv, i);
+				if (options.framesInFlight < 1 || options.framesInFlight > tv::TvFrameTimeline::MAX_FRAMES_IN_FLIGHT)
+				{
+					throw std::invalid_argument("--frames-in-flight has to be between 1 and 3");
+				}
+			}
+			else if (std::strcmp(argv[i], "--present") == 0)
+			{
+				options.presentPolicy = parsePresentPolicy(parseString(argc, argv, i));
+			}
+			else if (std::strcmp(argv[i], "--fps-limit") == 0)
+			{
+				options.fpsLimit = std::stod(parseString(argc, argv, i));
+			}
+			else if (std::strcmp(argv[i], "--draws") == 0)
+			{
+				options.drawCount = parseCount(argc, argv, i);
+			}
+			else if (std::strcmp(argv[i], "--record-threads") == 0)
+			{
+				options.recordThreads = parseCount(argc, argv, i);
+			}
+			else if (std::strcmp(argv[i], "--compile-threads") == 0)
+			{
+				options.compileThreads = parseCount(argc, argv, i);
+			}
+			else if (std::strcmp(argv[i], "--bench-record") == 0)
+			{
+				benchRecord = true;
+			}
+			else if (std::strcmp(argv[i], "--bench-instancing") == 0)
+			{
+				benchInstancing = true;
+			}
+			else if (std::strcmp(argv[i], "--stats-csv") == 0)
+			{
+				options.statsCsvPath = parseString(argc, argv, i);
+			}
+			else if (std::strcmp(argv[i], "--stats-json") == 0)
+			{
+				options.statsJsonPath = parseString(argc, argv, i);
+			}
+			else if (std::strcmp(argv[i], "--pipeline-cache") == 0)
+			{
+				options.pipelineCachePath = parseString(argc, argv, i);
+			}
+			else if (std::strcmp(argv[i], "--hot-reload") == 0)
+			{
+				options.hotReload = true;
+			}
+			else if (std::strcmp(argv[i], "--vertex-layout") == 0)
+			{
+				options.vertexLayout = parseVertexLayout(parseString(argc, argv, i));
+			}
+			else if (std::strcmp(argv[i], "--instanced") == 0)
+			{
+				options.instanced = true;
+			}
+			else if (std::strcmp(argv[i], "--gpu-driven") == 0)
+			{
+				options.gpuDriven = true;
+			}
+			else if (std::strcmp(argv[i], "--cull") == 0)
+			{
+				options.cull = true;
+			}
+			else if (std::strcmp(argv[i], "--occlusion") == 0)
+			{
+				options.occlusion = true;
+			}
+			else if (std::strcmp(argv[i], "--zoom") == 0)
+			{
+				options.zoom = std::stof(parseString(argc, argv, i));
+			}
+			else if (std::strcmp(argv[i], "--no-pipeline-library") == 0)
+			{
+				options.pipelineLibrary = false;
+			}
+			else if (std::strcmp(argv[i], "--shader-bundle") == 0)
+			{
+				options.shaderBundlePath = parseString(argc, argv, i);
+			}
+			else
+			{
+				throw std::invalid_argument(std::string("unknown option: ") + argv[i]);
+			}
+		}
+
+		// nobody is around to close a headless window, so give it something to stop at
+		if (options.headless && options.frameCount == 0)
+		{
+			options.frameCount = 1000;
+		}
+		return options;
+	}
+
+	// runs the same headless scene once per recording thread count and prints how long recording took,
+	// so you can see where adding threads stops paying off on this box
+	void runRecordBenchmark(tv::AppOptions options)
+	{
+		options.headless = true;
+		if (options.frameCount == 0)
+		{
+			options.frameCount = 300;
+		}
+		// a single triangle is nothing to split up, give the threads some work
+		if (options.drawCount <= 1)
+		{
+			options.drawCount = 20000;
+		}
+		// every frame should record the full draw list, not skip it while the pipeline compiles
+		options.compileThreads = 0;
+
+		// 0 is the inline (no secondaries) baseline, then powers of two up to the core count
+		uint32_t coreCount = std::max(std::thread::hardware_concurrency(), 1u);
+		std::vector<uint32_t> threadCounts{ 0 };
+		for (uint32_t threads = 1; threads < coreCount; threads *= 2)
+		{
+			threadCounts.push_back(threads);
+		}
+		threadCounts.push_back(coreCount);
+
+		struct Result
+		{
+			uint32_t threads;
+			tv::TvFrameStats::Summary record;
+		};
+		std::vector<Result> results;
+		for (uint32_t threads : threadCounts)
+		{
+			options.recordThreads = threads;
+			std::cout << "--- " << threads << " recording threads ---" << std::endl;
+			tv::FirstApp app{ options };
+			app.Run();
+			results.push_back({ threads, app.stats().summarize(&tv::FrameRecord::recordMs) });
+		}
+
+		std::cout << "\nrecording " << options.drawCount << " draws (ms, p50 / p95 / p99, speedup vs inline at p50):" << std::endl;
+		for (const Result& result : results)
+		{
+			std::cout << "	" << std::setw(8) << std::left << (result.threads == 0 ? std::string("inline") : std::to_string(result.threads))
+				<< std::fixed << std::setprecision(3) << result.record.p50 << " / " << result.record.p95 << " / " << result.record.p99
+				<< "	x" << std::setprecision(2) << (result.record.p50 > 0.0 ? results[0].record.p50 / result.record.p50 : 0.0) << std::endl;
+		}
+	}
+
+	// draws the same grid with one draw per object, with one instanced draw and gpu driven (one indirect draw), at a
+	// few object counts, and prints what each costs on the cpu (recording) and the gpu
+	// (the gpu driven grid cycles through the model's meshes instead of only drawing the triangle)
+	void runInstancingBenchmark(tv::AppOptions options)
+	{
+		options.headless = true;
+		if (options.frameCount == 0)
+		{
+			options.frameCount = 300;
+		}
+		options.compileThreads = 0;
+
+		struct Path
+		{
+			const char* name;
+			bool instanced;
+			bool gpuDriven;
+		};
+		const Path paths[] = { { "per object", false, false }, { "instanced", true, false }, { "gpu driven", false, true } };
+		const size_t pathCount = sizeof(paths) / sizeof(paths[0]);
+
+		struct Result
+		{
+			uint32_t drawCount;
+			const char* path;
+			tv::TvFrameStats::Summary record;
+			tv::TvFrameStats::Summary gpu;
+		};
+		std::vector<Result> results;
+		for (uint32_t drawCount : { 1000u, 10000u, 100000u })
+		{
+			for (const Path& path : paths)
+			{
+				options.drawCount = drawCount;
+				options.instanced = path.instanced;
+				options.gpuDriven = path.gpuDriven;
+				std::cout << "--- " << drawCount << " objects, " << path.name << " ---" << std::endl;
+				tv::FirstApp app{ options };
+				app.Run();
+				results.push_back({ drawCount, path.name, app.stats().summarize(&tv::FrameRecord::recordMs),
+					app.stats().summarize(&tv::FrameRecord::gpuMs) });
+			}
+		}
+
+		std::cout << "\nper object draws vs instanced vs gpu driven (ms at p50, speedup vs per object draws):" << std::endl;
+		std::cout << "	objects   path        record              gpu" << std::endl;
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Result& result = results[i];
+			// each count's per object run comes first
+			const Result& baseline = results[i - i % pathCount];
+			std::cout << "	" << std::setw(10) << std::left << result.drawCount << std::setw(12) << result.path
+				<< std::fixed << std::setprecision(3) << std::setw(8) << result.record.p50
+				<< " x" << std::setw(9) << std::setprecision(2) << (result.record.p50 > 0.0 ? baseline.record.p50 / result.record.p50 : 0.0);
+			if (result.gpu.count > 0)
+			{
+				std::cout << std::setprecision(3) << std::setw(8) << result.gpu.p50
+					<< " x" << std::setprecision(2) << (result.gpu.p50 > 0.0 ? baseline.gpu.p50 / result.gpu.p50 : 0.0);
+			}
+			else
+			{
+				std::cout << "n/a";
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	// build step, not a run: VulkanTest --pack-shaders OUT.tvsb a.spv b.spv ...
+	if (argc >= 2 && std::strcmp(argv[1], "--pack-shaders") == 0)
+	{
+		if (argc < 4)
+		{
+			std::cerr << "usage: VulkanTest --pack-shaders OUT SHADER.spv...\n";
+			return EXIT_FAILURE;
+		}
+		try
+		{
+			tv::TvShaderBundle::pack(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+			std::cout << "packed " << argc - 3 << " shaders into " << argv[2] << std::endl;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << "\n";
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	tv::AppOptions options;
+	bool benchRecord = false;
+	bool benchInstancing = false;
+	try
+	{
+		options = parseOptions(argc, argv, benchRecord, benchInstancing);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		std::cerr << "usage: VulkanTest [--headless] [--frames N] [--width W] [--height H]\n"
+			<< "                  [--frames-in-flight 1-3] [--present low-latency|power-saving|vsync|relaxed]\n"
+			<< "                  [--fps-limit FPS (0 = off)] [--draws N] [--record-threads N] [--compile-threads N]\n"
+			<< "                  [--bench-record] [--bench-instancing] [--stats-csv FILE] [--stats-json FILE]\n"
+			<< "                  [--pipeline-cache FILE] [--shader-bundle FILE] [--hot-reload]\n"
+			<< "                  [--no-pipeline-library] [--vertex-layout interleaved|split]\n"
+			<< "                  [--instanced] [--gpu-driven] [--cull] [--occlusion] [--zoom Z]\n"
+			<< "       VulkanTest --pack-shaders OUT SHADER.spv...\n";
+		return EXIT_FAILURE;
+	}
+
+	if (benchRecord || benchInstancing)
+	{
+		try
+		{
+			if (benchRecord)
+			{
+				runRecordBenchmark(options);
+			}
+			if (benchInstancing)
+			{
+				runInstancingBenchmark(options);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << "\n";
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	tv::FirstApp app{ options };
 
 	try
 	{
@@ -1,13 +1,21 @@
 #version 450
 
-vec2 positions[3] = vec2[]
-(
-	vec2(0.0, -0.5),
-	vec2(-0.5, 0.5),
-	vec2(0.5, 0.5)
-);
+// from the model's vertex buffer (TvModel::Vertex), binding 0 or two streams depending on the layout
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+
+layout(location = 0) out vec3 fragColor;
+
+// per draw, set with vkCmdPushConstants (SimplePushConstantData in first_app.cpp)
+layout(push_constant) uniform Push
+{
+	mat2 transform;
+	vec2 offset;
+	vec3 color;
+} push;
 
 void main()
 {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+	gl_Position = vec4(push.transform * position.xy + push.offset, position.z, 1.0);
+	fragColor = color * push.color;
 }
\ No newline at end of file
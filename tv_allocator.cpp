@@ -0,0 +1,294 @@
+#include "tv_allocator.hpp"
+
+// std
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+
+namespace tv
+{
+	// One vkAllocateMemory worth of memory, carved up by TvAllocator
+	struct TvMemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memoryType = 0;
+		uint32_t kind = 0;
+		char* mapped = nullptr;
+		// offset -> size of every free range, neighbours always get merged so no two ranges touch
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+		uint32_t allocationCount = 0;
+	};
+
+	namespace
+	{
+		VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	TvAllocator::TvAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize)
+		: device{ device }, preferredBlockSize{ blockSize }
+	{
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+	}
+
+	TvAllocator::~TvAllocator()
+	{
+		// anything still allocated at this point is a leak, but the memory goes back either way
+		for (auto& kinds : pools)
+		{
+			for (auto& pool : kinds)
+			{
+				for (auto& block : pool.blocks)
+				{
+					vkFreeMemory(device, block->memory, nullptr);
+				}
+			}
+		}
+	}
+
+	bool TvAllocator::tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t& typeIndex) const
+	{
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+		{
+			if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				typeIndex = i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	VkDeviceSize TvAllocator::blockSizeFor(uint32_t memoryType) const
+	{
+		// small heaps (like the 256MB host visible vram window) shouldn't get eaten by one block
+		VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[memoryType].heapIndex].size;
+		return std::min(preferredBlockSize, std::max<VkDeviceSize>(heapSize / 8, 1));
+	}
+
+	VkDeviceMemory TvAllocator::allocateMemory(VkDeviceSize size, uint32_t memoryType, const void* pNext, void** mapped)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.pNext = pNext;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate device memory");
+		}
+
+		// a memory object can only be mapped once, so host visible memory just stays mapped and everyone shares the pointer
+		*mapped = nullptr;
+		if (memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+			{
+				vkFreeMemory(device, memory, nullptr);
+				throw std::runtime_error("failed to map device memory");
+			}
+		}
+		counters.bytesReserved += size;
+		return memory;
+	}
+
+	std::unique_ptr<TvMemoryBlock> TvAllocator::createBlock(uint32_t memoryType, ResourceKind kind, VkDeviceSize minSize)
+	{
+		auto block = std::make_unique<TvMemoryBlock>();
+		block->size = std::max(blockSizeFor(memoryType), minSize);
+		block->memoryType = memoryType;
+		block->kind = static_cast<uint32_t>(kind);
+
+		void* mapped;
+		block->memory = allocateMemory(block->size, memoryType, nullptr, &mapped);
+		block->mapped = static_cast<char*>(mapped);
+		block->freeRanges[0] = block->size;
+		counters.blockCount++;
+		return block;
+	}
+
+	bool TvAllocator::allocateFromBlock(TvMemoryBlock& block, const VkMemoryRequirements& requirements, VkDeviceSize alignment, TvAllocation& allocation)
+	{
+		for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it)
+		{
+			VkDeviceSize rangeStart = it->first;
+			VkDeviceSize rangeEnd = it->first + it->second;
+			VkDeviceSize offset = alignUp(rangeStart, alignment);
+			// the end gets rounded up too so the next allocation doesn't share an atom/alignment unit with this one
+			VkDeviceSize end = alignUp(offset + requirements.size, alignment);
+			if (end > rangeEnd)
+			{
+				continue;
+			}
+
+			// the padding in front stays part of this allocation (it'd be too small to be useful anyway), the tail goes back on the list
+			block.freeRanges.erase(it);
+			if (end < rangeEnd)
+			{
+				block.freeRanges[end] = rangeEnd - end;
+			}
+
+			allocation.memory = block.memory;
+			allocation.offset = offset;
+			allocation.size = requirements.size;
+			allocation.mapped = block.mapped != nullptr ? block.mapped + offset : nullptr;
+			allocation.block = &block;
+			allocation.blockOffset = rangeStart;
+			allocation.blockSize = end - rangeStart;
+			block.allocationCount++;
+
+			counters.bytesUsed += requirements.size;
+			counters.bytesWasted += offset - rangeStart;
+			return true;
+		}
+		return false;
+	}
+
+	TvAllocation TvAllocator::allocate(
+		const VkMemoryRequirements& requirements,
+		VkMemoryPropertyFlags properties,
+		ResourceKind kind,
+		VkBuffer dedicatedBuffer,
+		VkImage dedicatedImage)
+	{
+		uint32_t memoryType;
+		if (!tryFindMemoryType(requirements.memoryTypeBits, properties, memoryType))
+		{
+			throw std::runtime_error("failed to find suitable memory type");
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		counters.totalAllocations++;
+		counters.allocationCount++;
+
+		TvAllocation allocation{};
+		const VkDeviceSize blockSize = blockSizeFor(memoryType);
+		if (dedicatedBuffer != VK_NULL_HANDLE || dedicatedImage != VK_NULL_HANDLE || requirements.size > blockSize / 2)
+		{
+			// big enough that sharing a block would mostly waste it
+			VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+			dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+			dedicatedInfo.buffer = dedicatedBuffer;
+			dedicatedInfo.image = dedicatedImage;
+			const bool hasResource = dedicatedBuffer != VK_NULL_HANDLE || dedicatedImage != VK_NULL_HANDLE;
+
+			allocation.memory = allocateMemory(requirements.size, memoryType, hasResource ? &dedicatedInfo : nullptr, &allocation.mapped);
+			allocation.size = requirements.size;
+			allocation.blockSize = requirements.size;
+			counters.dedicatedCount++;
+			counters.bytesUsed += requirements.size;
+			return allocation;
+		}
+
+		// non coherent host memory gets flushed in atoms, keep allocations from sharing one
+		VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+		const VkMemoryPropertyFlags typeFlags = memProperties.memoryTypes[memoryType].propertyFlags;
+		if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		{
+			alignment = std::max(alignment, nonCoherentAtomSize);
+		}
+
+		Pool& pool = pools[memoryType][static_cast<uint32_t>(kind)];
+		for (auto& block : pool.blocks)
+		{
+			if (allocateFromBlock(*block, requirements, alignment, allocation))
+			{
+				return allocation;
+			}
+		}
+
+		pool.blocks.push_back(createBlock(memoryType, kind, requirements.size));
+		if (!allocateFromBlock(*pool.blocks.back(), requirements, alignment, allocation))
+		{
+			throw std::runtime_error("failed to sub-allocate from a fresh memory block");
+		}
+		return allocation;
+	}
+
+	void TvAllocator::free(TvAllocation& allocation)
+	{
+		if (allocation.memory == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		counters.totalFrees++;
+		counters.allocationCount--;
+		counters.bytesUsed -= allocation.size;
+
+		TvMemoryBlock* block = allocation.block;
+		if (block == nullptr)
+		{
+			vkFreeMemory(device, allocation.memory, nullptr);
+			counters.dedicatedCount--;
+			counters.bytesReserved -= allocation.blockSize;
+			allocation = TvAllocation{};
+			return;
+		}
+		counters.bytesWasted -= allocation.offset - allocation.blockOffset;
+
+		// put the range back and merge it with whatever free ranges it touches
+		VkDeviceSize start = allocation.blockOffset;
+		VkDeviceSize end = allocation.blockOffset + allocation.blockSize;
+		auto next = block->freeRanges.lower_bound(start);
+		if (next != block->freeRanges.end() && next->first == end)
+		{
+			end += next->second;
+			next = block->freeRanges.erase(next);
+		}
+		if (next != block->freeRanges.begin())
+		{
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == start)
+			{
+				start = prev->first;
+				block->freeRanges.erase(prev);
+			}
+		}
+		block->freeRanges[start] = end - start;
+		block->allocationCount--;
+
+		// empty blocks go back to the driver, except the last one of a pool so alloc/free in a loop doesn't thrash
+		if (block->allocationCount == 0)
+		{
+			Pool& pool = pools[block->memoryType][block->kind];
+			if (pool.blocks.size() > 1)
+			{
+				auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [block](const auto& b) { return b.get() == block; });
+				vkFreeMemory(device, block->memory, nullptr);
+				counters.blockCount--;
+				counters.bytesReserved -= block->size;
+				pool.blocks.erase(it);
+			}
+		}
+		allocation = TvAllocation{};
+	}
+
+	TvAllocator::Stats TvAllocator::stats()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		return counters;
+	}
+
+	void TvAllocator::printStats(std::ostream& out)
+	{
+		Stats s = stats();
+		const double mb = 1024.0 * 1024.0;
+		out << std::fixed << std::setprecision(2)
+			<< "device memory: " << s.blockCount << " blocks + " << s.dedicatedCount << " dedicated, "
+			<< s.allocationCount << " live allocations (" << s.totalAllocations << " allocated / " << s.totalFrees << " freed overall)" << std::endl
+			<< "\t" << s.bytesReserved / mb << " MB reserved, " << s.bytesUsed / mb << " MB used, "
+			<< s.bytesWasted / mb << " MB lost to alignment" << std::defaultfloat << std::endl;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace tv
+{
+	struct TvMemoryBlock;
+
+	// A piece of device memory handed out by TvAllocator, bind your buffer/image to memory at offset
+	struct TvAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// host visible memory stays mapped for its whole life, this points at offset (nullptr otherwise)
+		void* mapped = nullptr;
+
+		// bookkeeping so free() knows where it came from, block is nullptr for dedicated allocations
+		TvMemoryBlock* block = nullptr;
+		VkDeviceSize blockOffset = 0;
+		VkDeviceSize blockSize = 0;
+	};
+
+	// Block based sub-allocator, so real assets don't each cost a vkAllocateMemory (there's a maxMemoryAllocationCount and it's not big)
+	// Each memory type gets its own list of big blocks, and linear (buffers) and optimal (images) resources get separate lists
+	// so bufferImageGranularity never comes into it. Inside a block it's first fit on a free list that merges neighbours back together.
+	// Anything big (or that the driver would rather have on its own) gets a dedicated allocation instead.
+	class TvAllocator
+	{
+	public:
+		enum class ResourceKind { Linear, Optimal };
+
+		struct Stats
+		{
+			uint32_t blockCount = 0;
+			uint32_t dedicatedCount = 0;
+			// live sub-allocations + dedicated allocations
+			uint32_t allocationCount = 0;
+			// lifetime totals
+			uint64_t totalAllocations = 0;
+			uint64_t totalFrees = 0;
+			// what we got from the driver (blocks + dedicated)
+			VkDeviceSize bytesReserved = 0;
+			// what resources asked for
+			VkDeviceSize bytesUsed = 0;
+			// alignment padding in front of sub-allocations
+			VkDeviceSize bytesWasted = 0;
+		};
+
+		// blocks are blockSize unless the heap is small, then an 8th of the heap
+		TvAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = 64ull * 1024 * 1024);
+		~TvAllocator();
+
+		TvAllocator(const TvAllocator&) = delete;
+		void operator=(const TvAllocator&) = delete;
+
+		// memory properties are queried once up front, this doesn't go back to the driver
+		bool tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t& typeIndex) const;
+		const VkPhysicalDeviceMemoryProperties& memoryProperties() const { return memProperties; }
+
+		// dedicatedBuffer/dedicatedImage: pass the resource if the driver prefers (or requires) it gets its own memory
+		TvAllocation allocate(
+			const VkMemoryRequirements& requirements,
+			VkMemoryPropertyFlags properties,
+			ResourceKind kind,
+			VkBuffer dedicatedBuffer = VK_NULL_HANDLE,
+			VkImage dedicatedImage = VK_NULL_HANDLE);
+		// gives the memory back and resets the allocation, fine to call on an empty one
+		void free(TvAllocation& allocation);
+
+		Stats stats();
+		void printStats(std::ostream& out);
+	private:
+		struct Pool
+		{
+			std::vector<std::unique_ptr<TvMemoryBlock>> blocks;
+		};
+
+		VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryType, const void* pNext, void** mapped);
+		std::unique_ptr<TvMemoryBlock> createBlock(uint32_t memoryType, ResourceKind kind, VkDeviceSize minSize);
+		bool allocateFromBlock(TvMemoryBlock& block, const VkMemoryRequirements& requirements, VkDeviceSize alignment, TvAllocation& allocation);
+		VkDeviceSize blockSizeFor(uint32_t memoryType) const;
+
+		VkDevice device;
+		VkPhysicalDeviceMemoryProperties memProperties{};
+		VkDeviceSize preferredBlockSize;
+		VkDeviceSize nonCoherentAtomSize = 1;
+
+		std::mutex mutex;
+		// [memory type][linear/optimal]
+		std::array<std::array<Pool, 2>, VK_MAX_MEMORY_TYPES> pools;
+		Stats counters;
+	};
+}
\ No newline at end of file
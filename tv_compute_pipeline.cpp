@@ -0,0 +1,49 @@
+#include "tv_compute_pipeline.hpp"
+
+// std
+#include <cassert>
+#include <stdexcept>
+#include <vector>
+
+namespace tv
+{
+	TvComputePipeline::TvComputePipeline(TvDevice& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout,
+		const SpecializationConstants& specialization, VkPipelineCache pipelineCache)
+		: tvDevice{ device }, pipelineLayout{ pipelineLayout }
+	{
+		assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+
+		// only has to live until the pipeline is created, same as the graphics shaders
+		std::shared_ptr<TvShaderModule> shaderModule = tvDevice.shaderModules().load(compFilepath);
+
+		std::vector<VkSpecializationMapEntry> entries;
+		std::vector<uint8_t> data;
+		VkSpecializationInfo specializationInfo = specialization.build(entries, data);
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shaderModule->handle();
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.stage.pSpecializationInfo = specialization.empty() ? nullptr : &specializationInfo;
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+		if (vkCreateComputePipelines(tvDevice.device(), pipelineCache, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create compute pipeline from " + compFilepath);
+		}
+	}
+
+	TvComputePipeline::~TvComputePipeline()
+	{
+		vkDestroyPipeline(tvDevice.device(), computePipeline, nullptr);
+	}
+
+	void TvComputePipeline::bind(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+	}
+}
\ No newline at end of file
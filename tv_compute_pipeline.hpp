@@ -0,0 +1,35 @@
+#pragma once
+#include "tv_device.hpp"
+#include "tv_pipeline.hpp"
+
+// std
+#include <cstdint>
+#include <string>
+
+namespace tv
+{
+	// A compute shader and its pipeline, the compute counterpart of TvPipeline
+	// The shader comes from the device's shader registry like the graphics ones do. Compute pipelines are small and
+	// there are few of them, so they're built right away instead of going through the compiler.
+	class TvComputePipeline
+	{
+	public:
+		// pipelineLayout stays owned by whoever made it (usually the device's layout cache)
+		TvComputePipeline(TvDevice& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout,
+			const SpecializationConstants& specialization = {}, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+		~TvComputePipeline();
+
+		TvComputePipeline(const TvComputePipeline&) = delete;
+		void operator=(const TvComputePipeline&) = delete;
+
+		void bind(VkCommandBuffer commandBuffer);
+		VkPipelineLayout layout() const { return pipelineLayout; }
+
+		// workgroups needed for count invocations in groups of groupSize
+		static uint32_t groupCount(uint32_t count, uint32_t groupSize) { return (count + groupSize - 1) / groupSize; }
+	private:
+		TvDevice& tvDevice;
+		VkPipelineLayout pipelineLayout;
+		VkPipeline computePipeline = VK_NULL_HANDLE;
+	};
+}
\ No newline at end of file
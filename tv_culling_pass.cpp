@@ -0,0 +1,328 @@
+#include "tv_culling_pass.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+namespace tv
+{
+	namespace
+	{
+		// has to match the push_constant block in cull.comp
+		struct CullPushConstants
+		{
+			glm::mat4 viewProjection;
+			glm::vec2 pyramidSize;
+			uint32_t objectCount;
+			uint32_t phase;
+		};
+
+		// has to match the Counters block in cull.comp, drawnCount is what the draws take their counts from
+		struct CullCounters
+		{
+			uint32_t drawnCount[2];
+			uint32_t frustumCulledCount;
+			uint32_t occludedCount;
+		};
+
+		VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment)
+		{
+			return (size + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	TvCullingPass::TvCullingPass(TvDevice& device, TvIndirectDrawList& drawList, uint32_t framesInFlight, bool occlusion,
+		VkPipelineCache pipelineCache)
+		: tvDevice{ device }, drawList{ drawList }, regionCount{ framesInFlight }, compact{ device.supportsDrawIndirectCount() },
+		occlusion{ occlusion }, readbackPending(framesInFlight, false)
+	{
+		createBuffers();
+
+		// bounds, every command, this frame's output commands and counters (and occluded flags), then the pyramid in a
+		// set of its own (it's recreated with the swapchain, the rest isn't)
+		PipelineLayoutDesc layoutDesc;
+		const uint32_t bufferCount = occlusion ? 5 : 4;
+		for (uint32_t binding = 0; binding < bufferCount; binding++)
+		{
+			layoutDesc.addBinding(0, binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+		}
+		if (occlusion)
+		{
+			TvDepthPyramid::addSampleBinding(layoutDesc, 1);
+		}
+		layoutDesc.addPushConstants<CullPushConstants>(VK_SHADER_STAGE_COMPUTE_BIT);
+		createDescriptorSets(tvDevice.layouts().setLayout(layoutDesc, 0));
+
+		pipeline = std::make_unique<TvComputePipeline>(tvDevice, occlusion ? "cull_occlusion.comp.spv" : "cull.comp.spv",
+			tvDevice.layouts().get(layoutDesc), SpecializationConstants{}.set(0, compact), pipelineCache);
+	}
+
+	TvCullingPass::~TvCullingPass()
+	{
+		// the sets go with the pool
+		vkDestroyDescriptorPool(tvDevice.device(), descriptorPool, nullptr);
+		tvDevice.destroyBuffer(readbackBuffer, readbackAllocation);
+		if (occludedBuffer != VK_NULL_HANDLE)
+		{
+			tvDevice.destroyBuffer(occludedBuffer, occludedAllocation);
+		}
+		tvDevice.destroyBuffer(counterBuffer, counterAllocation);
+		tvDevice.destroyBuffer(visibleBuffer, visibleAllocation);
+	}
+
+	void TvCullingPass::createBuffers()
+	{
+		const VkDeviceSize alignment = std::max<VkDeviceSize>(tvDevice.properties.limits.minStorageBufferOffsetAlignment, 4);
+		const VkDeviceSize phaseCount = occlusion ? 2 : 1;
+		visibleRegionSize = alignUp(sizeof(VkDrawIndexedIndirectCommand) * drawList.objectCount() * phaseCount, alignment);
+		counterRegionSize = alignUp(sizeof(CullCounters), alignment);
+
+		tvDevice.createBuffer(
+			visibleRegionSize * regionCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			visibleBuffer,
+			visibleAllocation);
+		// cleared with vkCmdFillBuffer at the start of every cull, and copied out for the stats at the end
+		tvDevice.createBuffer(
+			counterRegionSize * regionCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+				| VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			counterBuffer,
+			counterAllocation);
+		if (occlusion)
+		{
+			occludedRegionSize = alignUp(sizeof(uint32_t) * drawList.objectCount(), alignment);
+			tvDevice.createBuffer(
+				occludedRegionSize * regionCount,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				occludedBuffer,
+				occludedAllocation);
+		}
+
+		// a few bytes a frame, the shader's atomics stay in device local memory and only the totals come over
+		tvDevice.createBuffer(
+			sizeof(CullCounters) * regionCount,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			readbackBuffer,
+			readbackAllocation);
+		if (readbackAllocation.mapped == nullptr)
+		{
+			throw std::runtime_error("culling readback memory isn't mapped");
+		}
+	}
+
+	void TvCullingPass::createDescriptorSets(VkDescriptorSetLayout setLayout)
+	{
+		const uint32_t bufferCount = occlusion ? 5 : 4;
+
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = bufferCount * regionCount;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = regionCount;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		if (vkCreateDescriptorPool(tvDevice.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create culling descriptor pool");
+		}
+
+		std::vector<VkDescriptorSetLayout> setLayouts(regionCount, setLayout);
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = descriptorPool;
+		allocateInfo.descriptorSetCount = regionCount;
+		allocateInfo.pSetLayouts = setLayouts.data();
+		descriptorSets.resize(regionCount);
+		if (vkAllocateDescriptorSets(tvDevice.device(), &allocateInfo, descriptorSets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate culling descriptor sets");
+		}
+
+		// the inputs are the same for every frame, only the output regions move
+		for (uint32_t region = 0; region < regionCount; region++)
+		{
+			std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+			bufferInfos[0] = { drawList.boundsBuffer(), 0, VK_WHOLE_SIZE };
+			bufferInfos[1] = { drawList.commandBuffer(), 0, VK_WHOLE_SIZE };
+			bufferInfos[2] = { visibleBuffer, visibleRegionSize * region, visibleRegionSize };
+			bufferInfos[3] = { counterBuffer, counterRegionSize * region, sizeof(CullCounters) };
+			bufferInfos[4] = { occludedBuffer, occludedRegionSize * region, occludedRegionSize };
+
+			std::array<VkWriteDescriptorSet, 5> writes{};
+			for (uint32_t binding = 0; binding < bufferCount; binding++)
+			{
+				writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[binding].dstSet = descriptorSets[region];
+				writes[binding].dstBinding = binding;
+				writes[binding].descriptorCount = 1;
+				writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[binding].pBufferInfo = &bufferInfos[binding];
+			}
+			vkUpdateDescriptorSets(tvDevice.device(), bufferCount, writes.data(), 0, nullptr);
+		}
+	}
+
+	void TvCullingPass::record(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProjection,
+		Phase phase, TvDepthPyramid* pyramid)
+	{
+		assert((phase == Phase::First || occlusion) && "only occlusion culling has a second phase");
+		assert((pyramid != nullptr || !occlusion) && "occlusion culling needs a depth pyramid");
+
+		// nothing else touches this region until this frame index comes back around, and by then the frame that drew
+		// from it has retired (the timeline wait before acquiring covers that), so only this frame's own hazards need barriers
+		const VkDeviceSize counterOffset = counterRegionSize * frameIndex;
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		if (phase == Phase::First)
+		{
+			vkCmdFillBuffer(commandBuffer, counterBuffer, counterOffset, sizeof(CullCounters), 0);
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.buffer = counterBuffer;
+			barrier.offset = counterOffset;
+			barrier.size = sizeof(CullCounters);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				0, nullptr, 1, &barrier, 0, nullptr);
+		}
+		else
+		{
+			// the second phase reads the first one's flags and keeps counting where it left off (after the first
+			// phase's draw has read its count)
+			std::array<VkBufferMemoryBarrier, 2> phaseBarriers{ barrier, barrier };
+			for (VkBufferMemoryBarrier& phaseBarrier : phaseBarriers)
+			{
+				phaseBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				phaseBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			}
+			phaseBarriers[0].buffer = counterBuffer;
+			phaseBarriers[0].offset = counterOffset;
+			phaseBarriers[0].size = sizeof(CullCounters);
+			phaseBarriers[1].buffer = occludedBuffer;
+			phaseBarriers[1].offset = occludedRegionSize * frameIndex;
+			phaseBarriers[1].size = occludedRegionSize;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, static_cast<uint32_t>(phaseBarriers.size()),
+				phaseBarriers.data(), 0, nullptr);
+		}
+
+		CullPushConstants push{};
+		push.viewProjection = viewProjection;
+		push.objectCount = drawList.objectCount();
+		push.phase = phase == Phase::First ? 0 : 1;
+
+		pipeline->bind(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout(), 0, 1, &descriptorSets[frameIndex], 0, nullptr);
+		if (occlusion)
+		{
+			VkDescriptorSet pyramidSet = pyramid->sampleSet();
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout(), 1, 1, &pyramidSet, 0, nullptr);
+			push.pyramidSize = { static_cast<float>(pyramid->extent().width), static_cast<float>(pyramid->extent().height) };
+		}
+		vkCmdPushConstants(commandBuffer, pipeline->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &push);
+		vkCmdDispatch(commandBuffer, TvComputePipeline::groupCount(drawList.objectCount(), GROUP_SIZE), 1, 1);
+
+		finishPhase(commandBuffer, frameIndex, phase);
+	}
+
+	void TvCullingPass::finishPhase(VkCommandBuffer commandBuffer, uint32_t frameIndex, Phase phase)
+	{
+		const bool lastPhase = !occlusion || phase == Phase::Second;
+		const VkDeviceSize counterOffset = counterRegionSize * frameIndex;
+		const VkDeviceSize phaseSize = sizeof(VkDrawIndexedIndirectCommand) * drawList.objectCount();
+
+		// the commands and the counters are read by the indirect draw later in this command buffer, and the counters by
+		// the copy below
+		std::array<VkBufferMemoryBarrier, 2> drawBarriers{};
+		for (VkBufferMemoryBarrier& barrier : drawBarriers)
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		}
+		drawBarriers[0].buffer = visibleBuffer;
+		drawBarriers[0].offset = visibleRegionSize * frameIndex + (phase == Phase::First ? 0 : phaseSize);
+		drawBarriers[0].size = phaseSize;
+		drawBarriers[1].buffer = counterBuffer;
+		drawBarriers[1].offset = counterOffset;
+		drawBarriers[1].size = sizeof(CullCounters);
+		VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		if (lastPhase)
+		{
+			drawBarriers[1].dstAccessMask |= VK_ACCESS_TRANSFER_READ_BIT;
+			dstStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0,
+			0, nullptr, static_cast<uint32_t>(drawBarriers.size()), drawBarriers.data(), 0, nullptr);
+
+		if (!lastPhase)
+		{
+			return;
+		}
+
+		// the host reads them once the frame has retired, which still needs the writes made visible to it
+		VkBufferCopy copy{ counterOffset, sizeof(CullCounters) * frameIndex, sizeof(CullCounters) };
+		vkCmdCopyBuffer(commandBuffer, counterBuffer, readbackBuffer, 1, &copy);
+		VkBufferMemoryBarrier hostBarrier{};
+		hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		hostBarrier.buffer = readbackBuffer;
+		hostBarrier.offset = copy.dstOffset;
+		hostBarrier.size = copy.size;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+			0, nullptr, 1, &hostBarrier, 0, nullptr);
+		readbackPending[frameIndex] = true;
+	}
+
+	void TvCullingPass::draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, Phase phase)
+	{
+		drawList.bind(commandBuffer);
+		const uint32_t phaseIndex = phase == Phase::First ? 0 : 1;
+		const VkDeviceSize visibleOffset = visibleRegionSize * frameIndex
+			+ sizeof(VkDrawIndexedIndirectCommand) * drawList.objectCount() * phaseIndex;
+		if (compact)
+		{
+			const VkDeviceSize countOffset = counterRegionSize * frameIndex + offsetof(CullCounters, drawnCount) + sizeof(uint32_t) * phaseIndex;
+			vkCmdDrawIndexedIndirectCount(commandBuffer, visibleBuffer, visibleOffset, counterBuffer, countOffset,
+				drawList.objectCount(), sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, visibleBuffer, visibleOffset, drawList.objectCount(), sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
+
+	bool TvCullingPass::readStats(uint32_t frameIndex, CullStats& stats)
+	{
+		if (!readbackPending[frameIndex])
+		{
+			return false;
+		}
+		readbackPending[frameIndex] = false;
+
+		const CullCounters& counters = static_cast<const CullCounters*>(readbackAllocation.mapped)[frameIndex];
+		stats.tested = drawList.objectCount();
+		stats.frustumCulled = counters.frustumCulledCount;
+		stats.drawn = counters.drawnCount[0] + counters.drawnCount[1];
+		// the second phase only draws objects the first one counted as occluded
+		stats.occlusionCulled = counters.occludedCount - counters.drawnCount[1];
+		return true;
+	}
+}
\ No newline at end of file
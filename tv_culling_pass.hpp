@@ -0,0 +1,116 @@
+#pragma once
+#include "tv_device.hpp"
+#include "tv_compute_pipeline.hpp"
+#include "tv_depth_pyramid.hpp"
+#include "tv_indirect_draw_list.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace tv
+{
+	// What one frame's culling did with the draw list
+	struct CullStats
+	{
+		uint32_t tested = 0;
+		uint32_t frustumCulled = 0;
+		// still hidden after both phases (always 0 without occlusion culling)
+		uint32_t occlusionCulled = 0;
+		uint32_t drawn = 0;
+
+		uint32_t culled() const { return frustumCulled + occlusionCulled; }
+	};
+
+	// Frustum (and optionally occlusion) culling for a TvIndirectDrawList on the gpu
+	// A compute pass tests every object's bounding sphere against the frustum and writes the commands of the ones that
+	// survive into a compacted list plus a count, which the draw then reads with vkCmdDrawIndexedIndirectCount, all in
+	// the same command buffer. Without drawIndirectCount the list isn't compacted: culled commands keep their slot with
+	// an instance count of 0.
+	// With occlusion culling there are two phases. The first tests what's in the frustum against a depth pyramid built
+	// from last frame's depth and draws what isn't behind it. Then the pyramid is rebuilt from the depth the first phase
+	// drew, and the second phase tests only what the first one hid against that: whatever has come into view since last
+	// frame gets drawn after all, so nothing pops in a frame late.
+	// The output has one region per frame in flight, so culling a frame never writes what an earlier one is still drawing.
+	class TvCullingPass
+	{
+	public:
+		// has to match local_size_x in cull.comp
+		static constexpr uint32_t GROUP_SIZE = 64;
+
+		enum class Phase
+		{
+			First,
+			// occlusion culling only
+			Second,
+		};
+
+		// drawList has to outlive the pass
+		TvCullingPass(TvDevice& device, TvIndirectDrawList& drawList, uint32_t framesInFlight, bool occlusion = false,
+			VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+		~TvCullingPass();
+
+		TvCullingPass(const TvCullingPass&) = delete;
+		void operator=(const TvCullingPass&) = delete;
+
+		// culls into this frame's region for one phase, outside a render pass and before that phase's draw (the barriers
+		// for the draw are in here). the first phase starts the frame over, the second has to come after it and its draw.
+		// pyramid is what objects are tested against with occlusion culling (built, or cleared when there's nothing to
+		// build it from), and ignored without
+		void record(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProjection,
+			Phase phase = Phase::First, TvDepthPyramid* pyramid = nullptr);
+		// binds the draw list and draws what record() left in this frame's region for the phase, inside a render pass
+		void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, Phase phase = Phase::First);
+		// what the last cull recorded for this frame index found, false if it has already been read (or nothing was
+		// recorded). only once the frame has retired
+		bool readStats(uint32_t frameIndex, CullStats& stats);
+
+		bool isCompacting() const { return compact; }
+		bool hasOcclusion() const { return occlusion; }
+		// output, counter and readback buffer bytes, every region
+		VkDeviceSize memorySize() const
+		{
+			return visibleAllocation.size + counterAllocation.size + occludedAllocation.size + readbackAllocation.size;
+		}
+	private:
+		void createBuffers();
+		void createDescriptorSets(VkDescriptorSetLayout setLayout);
+		// makes the phase's commands and the counters readable by the draw, and copies the counters out for readStats
+		// once the last phase is done
+		void finishPhase(VkCommandBuffer commandBuffer, uint32_t frameIndex, Phase phase);
+
+		TvDevice& tvDevice;
+		TvIndirectDrawList& drawList;
+		uint32_t regionCount;
+		bool compact;
+		bool occlusion;
+
+		// per frame regions, all start on minStorageBufferOffsetAlignment so each frame's descriptors can point at them
+		// the visible commands have room for every object in each phase, the counters are CullCounters
+		VkDeviceSize visibleRegionSize = 0;
+		VkDeviceSize counterRegionSize = 0;
+		VkDeviceSize occludedRegionSize = 0;
+		VkBuffer visibleBuffer = VK_NULL_HANDLE;
+		TvAllocation visibleAllocation;
+		VkBuffer counterBuffer = VK_NULL_HANDLE;
+		TvAllocation counterAllocation;
+		// one flag per object, occlusion culling only
+		VkBuffer occludedBuffer = VK_NULL_HANDLE;
+		TvAllocation occludedAllocation;
+		// each frame's counters end up here (host visible, persistently mapped), and whether they're unread
+		VkBuffer readbackBuffer = VK_NULL_HANDLE;
+		TvAllocation readbackAllocation;
+		std::vector<bool> readbackPending;
+
+		// one set per frame in flight, written once
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> descriptorSets;
+		std::unique_ptr<TvComputePipeline> pipeline;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,291 @@
+#include "tv_depth_pyramid.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace tv
+{
+	namespace
+	{
+		// has to match the push_constant block in depth_pyramid.comp
+		struct ReducePushConstants
+		{
+			int32_t sourceWidth;
+			int32_t sourceHeight;
+			int32_t destinationWidth;
+			int32_t destinationHeight;
+		};
+
+		uint32_t previousPowerOfTwo(uint32_t value)
+		{
+			uint32_t result = 1;
+			while (result * 2 <= value)
+			{
+				result *= 2;
+			}
+			return result;
+		}
+
+		VkExtent2D levelExtent(VkExtent2D extent, uint32_t level)
+		{
+			return { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) };
+		}
+	}
+
+	TvDepthPyramid::TvDepthPyramid(TvDevice& device, TvSwapChain& swapChain, VkPipelineCache pipelineCache)
+		: tvDevice{ device }, swapChain{ swapChain }
+	{
+		if (!swapChain.isDepthSampled())
+		{
+			throw std::runtime_error("a depth pyramid needs a swapchain with sampled depth");
+		}
+
+		pyramidExtent = { previousPowerOfTwo(swapChain.width()), previousPowerOfTwo(swapChain.height()) };
+		levels = 1;
+		while ((std::max(pyramidExtent.width, pyramidExtent.height) >> levels) > 0)
+		{
+			levels++;
+		}
+		createImage();
+
+		// the level above (or the depth attachment) in, this level out
+		PipelineLayoutDesc reduceDesc;
+		reduceDesc.addBinding(0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT);
+		reduceDesc.addBinding(0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);
+		reduceDesc.addPushConstants<ReducePushConstants>(VK_SHADER_STAGE_COMPUTE_BIT);
+		PipelineLayoutDesc sampleDesc;
+		addSampleBinding(sampleDesc, 0);
+		createDescriptorSets(tvDevice.layouts().setLayout(reduceDesc, 0), tvDevice.layouts().setLayout(sampleDesc, 0));
+
+		pipeline = std::make_unique<TvComputePipeline>(tvDevice, "depth_pyramid.comp.spv", tvDevice.layouts().get(reduceDesc),
+			SpecializationConstants{}, pipelineCache);
+	}
+
+	TvDepthPyramid::~TvDepthPyramid()
+	{
+		// the sets go with the pool
+		vkDestroyDescriptorPool(tvDevice.device(), descriptorPool, nullptr);
+		vkDestroySampler(tvDevice.device(), sampler, nullptr);
+		for (VkImageView view : levelViews)
+		{
+			vkDestroyImageView(tvDevice.device(), view, nullptr);
+		}
+		vkDestroyImageView(tvDevice.device(), fullView, nullptr);
+		tvDevice.destroyImage(image, allocation);
+	}
+
+	void TvDepthPyramid::addSampleBinding(PipelineLayoutDesc& layoutDesc, uint32_t set)
+	{
+		layoutDesc.addBinding(set, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+
+	void TvDepthPyramid::createImage()
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = pyramidExtent.width;
+		imageInfo.extent.height = pyramidExtent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = levels;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// cleared with vkCmdClearColorImage when there's no depth to build from
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		tvDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, allocation);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = levels;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+		if (vkCreateImageView(tvDevice.device(), &viewInfo, nullptr, &fullView) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create depth pyramid view");
+		}
+
+		levelViews.resize(levels);
+		viewInfo.subresourceRange.levelCount = 1;
+		for (uint32_t level = 0; level < levels; level++)
+		{
+			viewInfo.subresourceRange.baseMipLevel = level;
+			if (vkCreateImageView(tvDevice.device(), &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create depth pyramid level view");
+			}
+		}
+
+		// the reduction only does texelFetch, the culling picks a level and wants the texel it lands in
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		if (vkCreateSampler(tvDevice.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create depth pyramid sampler");
+		}
+	}
+
+	void TvDepthPyramid::createDescriptorSets(VkDescriptorSetLayout reduceSetLayout, VkDescriptorSetLayout sampleSetLayout)
+	{
+		const uint32_t depthCount = static_cast<uint32_t>(swapChain.depthImageCount());
+		const uint32_t reduceSetCount = depthCount + levels - 1;
+
+		std::array<VkDescriptorPoolSize, 2> poolSizes{};
+		poolSizes[0] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, reduceSetCount + 1 };
+		poolSizes[1] = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, reduceSetCount };
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = reduceSetCount + 1;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		if (vkCreateDescriptorPool(tvDevice.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create depth pyramid descriptor pool");
+		}
+
+		std::vector<VkDescriptorSetLayout> setLayouts(reduceSetCount, reduceSetLayout);
+		setLayouts.push_back(sampleSetLayout);
+		std::vector<VkDescriptorSet> sets(setLayouts.size());
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = descriptorPool;
+		allocateInfo.descriptorSetCount = static_cast<uint32_t>(sets.size());
+		allocateInfo.pSetLayouts = setLayouts.data();
+		if (vkAllocateDescriptorSets(tvDevice.device(), &allocateInfo, sets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate depth pyramid descriptor sets");
+		}
+		depthSets.assign(sets.begin(), sets.begin() + depthCount);
+		levelSets.assign(sets.begin() + depthCount, sets.begin() + reduceSetCount);
+		sampleDescriptorSet = sets.back();
+
+		// written once, the image stays in GENERAL while it's built and sampled
+		auto writeReduceSet = [this](VkDescriptorSet set, VkImageView sourceView, VkImageLayout sourceLayout, uint32_t level)
+		{
+			VkDescriptorImageInfo sourceInfo{ sampler, sourceView, sourceLayout };
+			VkDescriptorImageInfo destinationInfo{ VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+
+			std::array<VkWriteDescriptorSet, 2> writes{};
+			for (uint32_t binding = 0; binding < writes.size(); binding++)
+			{
+				writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[binding].dstSet = set;
+				writes[binding].dstBinding = binding;
+				writes[binding].descriptorCount = 1;
+			}
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[0].pImageInfo = &sourceInfo;
+			writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[1].pImageInfo = &destinationInfo;
+			vkUpdateDescriptorSets(tvDevice.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		};
+		for (uint32_t i = 0; i < depthCount; i++)
+		{
+			writeReduceSet(depthSets[i], swapChain.getDepthImageView(i), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0);
+		}
+		for (uint32_t level = 1; level < levels; level++)
+		{
+			writeReduceSet(levelSets[level - 1], levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL, level);
+		}
+
+		VkDescriptorImageInfo sampleInfo{ sampler, fullView, VK_IMAGE_LAYOUT_GENERAL };
+		VkWriteDescriptorSet sampleWrite{};
+		sampleWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		sampleWrite.dstSet = sampleDescriptorSet;
+		sampleWrite.dstBinding = 0;
+		sampleWrite.descriptorCount = 1;
+		sampleWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		sampleWrite.pImageInfo = &sampleInfo;
+		vkUpdateDescriptorSets(tvDevice.device(), 1, &sampleWrite, 0, nullptr);
+	}
+
+	void TvDepthPyramid::build(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+	{
+		// the whole pyramid gets rewritten, so the old contents can go. the source stage covers whatever sampled it
+		// last (earlier culls in this frame or the one before)
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+
+		pipeline->bind(commandBuffer);
+		VkExtent2D source = swapChain.getSwapChainExtent();
+		for (uint32_t level = 0; level < levels; level++)
+		{
+			VkDescriptorSet set = level == 0 ? depthSets[frameIndex % depthSets.size()] : levelSets[level - 1];
+			const VkExtent2D destination = levelExtent(pyramidExtent, level);
+			ReducePushConstants push{};
+			push.sourceWidth = static_cast<int32_t>(source.width);
+			push.sourceHeight = static_cast<int32_t>(source.height);
+			push.destinationWidth = static_cast<int32_t>(destination.width);
+			push.destinationHeight = static_cast<int32_t>(destination.height);
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout(), 0, 1, &set, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipeline->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ReducePushConstants), &push);
+			vkCmdDispatch(commandBuffer, TvComputePipeline::groupCount(destination.width, GROUP_SIZE),
+				TvComputePipeline::groupCount(destination.height, GROUP_SIZE), 1);
+
+			// the next level reads this one (and the last one is read by the culling)
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+			source = destination;
+		}
+	}
+
+	void TvDepthPyramid::clear(VkCommandBuffer commandBuffer)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkClearColorValue farPlane{};
+		farPlane.float32[0] = 1.0f;
+		vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &barrier.subresourceRange);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+#include "tv_device.hpp"
+#include "tv_compute_pipeline.hpp"
+#include "tv_pipeline_layout.hpp"
+#include "tv_swap_chain.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace tv
+{
+	// A hierarchical z buffer: the depth attachment reduced into an R32F mip chain, every texel holding the farthest
+	// depth under it
+	// Level 0 is the largest power of two that fits in the attachment, so every level after it is exactly half the one
+	// above and a screen rectangle can be tested against at most 2x2 texels of the right level. Built by a compute
+	// pass per level, and sampled by TvCullingPass to throw away objects that are behind what's already been drawn.
+	// There's one pyramid, rebuilt whenever it's needed, and it goes with the swapchain it was made for (the depth
+	// attachments have to be sampled, see TvSwapChain's sampledDepth).
+	class TvDepthPyramid
+	{
+	public:
+		// has to match local_size_x/y in depth_pyramid.comp
+		static constexpr uint32_t GROUP_SIZE = 8;
+
+		// swapChain has to outlive the pyramid
+		TvDepthPyramid(TvDevice& device, TvSwapChain& swapChain, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+		~TvDepthPyramid();
+
+		TvDepthPyramid(const TvDepthPyramid&) = delete;
+		void operator=(const TvDepthPyramid&) = delete;
+
+		// reduces the depth attachment that goes with frameIndex, which has to have been rendered to (it's in
+		// SHADER_READ_ONLY_OPTIMAL once a render pass has ended). outside a render pass, the result is ready for
+		// compute shaders to sample afterwards
+		void build(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+		// every level at the far plane, for when there's no depth to build from yet (nothing is occluded by it)
+		void clear(VkCommandBuffer commandBuffer);
+
+		// the whole pyramid as a combined image sampler (nearest, clamped) at binding 0, layout from addSampleBinding
+		VkDescriptorSet sampleSet() const { return sampleDescriptorSet; }
+		// adds the binding sampleSet() fills in, as set `set` of a compute pipeline layout
+		static void addSampleBinding(PipelineLayoutDesc& layoutDesc, uint32_t set);
+
+		VkExtent2D extent() const { return pyramidExtent; }
+		uint32_t levelCount() const { return levels; }
+		VkDeviceSize memorySize() const { return allocation.size; }
+	private:
+		void createImage();
+		void createDescriptorSets(VkDescriptorSetLayout reduceSetLayout, VkDescriptorSetLayout sampleSetLayout);
+
+		TvDevice& tvDevice;
+		TvSwapChain& swapChain;
+		VkExtent2D pyramidExtent;
+		uint32_t levels;
+
+		VkImage image = VK_NULL_HANDLE;
+		TvAllocation allocation;
+		// every level, for sampling
+		VkImageView fullView = VK_NULL_HANDLE;
+		// one level each, for writing
+		std::vector<VkImageView> levelViews;
+		VkSampler sampler = VK_NULL_HANDLE;
+
+		// level 0 has one set per depth attachment, then one per level after it (reading the level above)
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> depthSets;
+		std::vector<VkDescriptorSet> levelSets;
+		VkDescriptorSet sampleDescriptorSet = VK_NULL_HANDLE;
+		std::unique_ptr<TvComputePipeline> pipeline;
+	};
+}
\ No newline at end of file
@@ -56,9 +56,15 @@ TvDevice::TvDevice(TvWindow &window) : window{window} {
   pickPhysicalDevice();
   createLogicalDevice();
   createCommandPool();
+  createAllocator();
+  shaderRegistry_ = std::make_unique<TvShaderRegistry>(device_);
+  layoutCache_ = std::make_unique<TvLayoutCache>(device_, properties.limits.maxPushConstantsSize);
 }
 
 TvDevice::~TvDevice() {
+  layoutCache_.reset();
+  shaderRegistry_.reset();
+  allocator_.reset();
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
@@ -66,7 +72,9 @@ TvDevice::~TvDevice() {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
 
-  vkDestroySurfaceKHR(instance, surface_, nullptr);
+  if (surface_ != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(instance, surface_, nullptr);
+  }
   vkDestroyInstance(instance, nullptr);
 }
 
@@ -81,7 +89,8 @@ void TvDevice::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  // 1.2 for timeline semaphores (frame pacing)
+  appInfo.apiVersion = VK_API_VERSION_1_2;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -139,7 +148,8 @@ void TvDevice::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+  std::set<uint32_t> uniqueQueueFamilies = {
+      indices.graphicsFamily, indices.presentFamily, indices.transferFamily};
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -154,15 +164,61 @@ void TvDevice::createLogicalDevice() {
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+  VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+  vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  vulkan12Features.timelineSemaphore = VK_TRUE;
+
+  // optional: gpu driven draws (see TvIndirectDrawList), many indirect draws per call that can each start at any
+  // instance, with the draw count read from a buffer if the device can
+  VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {};
+  supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 supportedFeatures = {};
+  supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supportedFeatures.pNext = &supportedVulkan12Features;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+  multiDrawIndirect_ = supportedFeatures.features.multiDrawIndirect &&
+                       supportedFeatures.features.drawIndirectFirstInstance;
+  drawIndirectCount_ = multiDrawIndirect_ && supportedVulkan12Features.drawIndirectCount;
+  deviceFeatures.multiDrawIndirect = multiDrawIndirect_;
+  deviceFeatures.drawIndirectFirstInstance = multiDrawIndirect_;
+  vulkan12Features.drawIndirectCount = drawIndirectCount_;
+
+  // optional: lets one pipeline cover several raster/depth states
+  auto extensions = getRequiredDeviceExtensions();
+  bool extendedDynamicState = hasExtendedDynamicStateSupport(physicalDevice);
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {};
+  extendedDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+  void **featuresEnd = &vulkan12Features.pNext;
+  if (extendedDynamicState) {
+    extendedDynamicStateFeatures.extendedDynamicState = VK_TRUE;
+    *featuresEnd = &extendedDynamicStateFeatures;
+    featuresEnd = &extendedDynamicStateFeatures.pNext;
+    extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+  }
+
+  // optional: pipelines built from separately compiled parts (see TvPipelineLibrary)
+  graphicsPipelineLibrary_ = hasGraphicsPipelineLibrarySupport(physicalDevice);
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures = {};
+  graphicsPipelineLibraryFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+  if (graphicsPipelineLibrary_) {
+    graphicsPipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+    *featuresEnd = &graphicsPipelineLibraryFeatures;
+    featuresEnd = &graphicsPipelineLibraryFeatures.pNext;
+    extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+    extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+  }
+
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  createInfo.pNext = &vulkan12Features;
 
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -179,6 +235,29 @@ void TvDevice::createLogicalDevice() {
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+
+  // extension commands aren't exported by the loader, they have to be looked up
+  if (extendedDynamicState) {
+    extendedDynamicState_.cmdSetCullMode = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetCullModeEXT"));
+    extendedDynamicState_.cmdSetFrontFace = reinterpret_cast<PFN_vkCmdSetFrontFaceEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetFrontFaceEXT"));
+    extendedDynamicState_.cmdSetPrimitiveTopology = reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetPrimitiveTopologyEXT"));
+    extendedDynamicState_.cmdSetDepthTestEnable = reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetDepthTestEnableEXT"));
+    extendedDynamicState_.cmdSetDepthWriteEnable = reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetDepthWriteEnableEXT"));
+    extendedDynamicState_.cmdSetDepthCompareOp = reinterpret_cast<PFN_vkCmdSetDepthCompareOpEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetDepthCompareOpEXT"));
+    // all or nothing, so supportsExtendedDynamicState() can just look at one of them
+    if (!extendedDynamicState_.cmdSetCullMode || !extendedDynamicState_.cmdSetFrontFace ||
+        !extendedDynamicState_.cmdSetPrimitiveTopology || !extendedDynamicState_.cmdSetDepthTestEnable ||
+        !extendedDynamicState_.cmdSetDepthWriteEnable || !extendedDynamicState_.cmdSetDepthCompareOp) {
+      extendedDynamicState_ = {};
+    }
+  }
 }
 
 void TvDevice::createCommandPool() {
@@ -195,7 +274,15 @@ void TvDevice::createCommandPool() {
   }
 }
 
-void TvDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+void TvDevice::createAllocator() {
+  allocator_ = std::make_unique<TvAllocator>(physicalDevice, device_);
+}
+
+void TvDevice::createSurface() {
+  // headless runs render into offscreen images, there is nothing to present to
+  if (window.isHeadless()) return;
+  window.createWindowSurface(instance, &surface_);
+}
 
 bool TvDevice::isDeviceSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
@@ -203,7 +290,9 @@ bool TvDevice::isDeviceSuitable(VkPhysicalDevice device) {
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
   bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  if (window.isHeadless()) {
+    swapChainAdequate = true;
+  } else if (extensionsSupported) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
@@ -211,8 +300,22 @@ bool TvDevice::isDeviceSuitable(VkPhysicalDevice device) {
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
+  // frame pacing is built on a timeline semaphore, which needs a 1.2 device
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(device, &deviceProperties);
+  bool timelineSupported = false;
+  if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &vulkan12Features;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    timelineSupported = vulkan12Features.timelineSemaphore;
+  }
+
   return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy;
+         supportedFeatures.samplerAnisotropy && timelineSupported;
 }
 
 void TvDevice::populateDebugMessengerCreateInfo(
@@ -263,11 +366,15 @@ bool TvDevice::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> TvDevice::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  std::vector<const char *> extensions;
+
+  // glfw is never initialized in headless mode, and we don't need any surface extensions anyway
+  if (!window.isHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -310,6 +417,7 @@ bool TvDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
       &extensionCount,
       availableExtensions.data());
 
+  auto deviceExtensions = getRequiredDeviceExtensions();
   std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
   for (const auto &extension : availableExtensions) {
@@ -319,6 +427,71 @@ bool TvDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+bool TvDevice::hasDeviceExtension(VkPhysicalDevice device, const char *name) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(
+      device,
+      nullptr,
+      &extensionCount,
+      availableExtensions.data());
+
+  for (const auto &extension : availableExtensions) {
+    if (strcmp(extension.extensionName, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TvDevice::hasExtendedDynamicStateSupport(VkPhysicalDevice device) {
+  if (!hasDeviceExtension(device, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+    return false;
+  }
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {};
+  extendedDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features2 = {};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &extendedDynamicStateFeatures;
+  vkGetPhysicalDeviceFeatures2(device, &features2);
+  return extendedDynamicStateFeatures.extendedDynamicState;
+}
+
+bool TvDevice::hasGraphicsPipelineLibrarySupport(VkPhysicalDevice device) {
+  if (!hasDeviceExtension(device, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) ||
+      !hasDeviceExtension(device, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    return false;
+  }
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures = {};
+  graphicsPipelineLibraryFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features2 = {};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &graphicsPipelineLibraryFeatures;
+  vkGetPhysicalDeviceFeatures2(device, &features2);
+
+  // without fast linking an unoptimized link can cost as much as a whole compile, so there's no point
+  VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProperties = {};
+  graphicsPipelineLibraryProperties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+  VkPhysicalDeviceProperties2 properties2 = {};
+  properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties2.pNext = &graphicsPipelineLibraryProperties;
+  vkGetPhysicalDeviceProperties2(device, &properties2);
+  return graphicsPipelineLibraryFeatures.graphicsPipelineLibrary &&
+         graphicsPipelineLibraryProperties.graphicsPipelineLibraryFastLinking;
+}
+
+std::vector<const char *> TvDevice::getRequiredDeviceExtensions() {
+  // no surface means no swapchain, so headless runs work on devices/ICDs without VK_KHR_swapchain
+  if (window.isHeadless()) {
+    return {};
+  }
+  return deviceExtensions;
+}
+
 QueueFamilyIndices TvDevice::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -328,14 +501,22 @@ QueueFamilyIndices TvDevice::findQueueFamilies(VkPhysicalDevice device) {
   std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+  // the graphics family has to do compute too, compute passes (culling) go in the same command buffer as the draws
+  // that use their output. a device with graphics always has a family that does both
+  const VkQueueFlags graphicsFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
   int i = 0;
   for (const auto &queueFamily : queueFamilies) {
-    if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & graphicsFlags) == graphicsFlags) {
       indices.graphicsFamily = i;
       indices.graphicsFamilyHasValue = true;
     }
+    // headless "presents" are just submissions on the graphics queue, so it doubles as present queue
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    if (window.isHeadless()) {
+      presentSupport = indices.graphicsFamilyHasValue && indices.graphicsFamily == static_cast<uint32_t>(i);
+    } else {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    }
     if (queueFamily.queueCount > 0 && presentSupport) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
@@ -347,9 +528,33 @@ QueueFamilyIndices TvDevice::findQueueFamilies(VkPhysicalDevice device) {
     i++;
   }
 
+  // uploads go on a transfer only family if there is one, so they run on the copy engine
+  // alongside rendering instead of queueing up behind it
+  indices.transferFamily = indices.graphicsFamily;
+  for (uint32_t family = 0; family < queueFamilyCount; family++) {
+    VkQueueFlags flags = queueFamilies[family].queueFlags;
+    if (queueFamilies[family].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & VK_QUEUE_GRAPHICS_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT)) {
+      indices.transferFamily = family;
+      indices.hasDedicatedTransferFamily = true;
+      break;
+    }
+  }
+
   return indices;
 }
 
+uint32_t TvDevice::getGraphicsQueueTimestampBits() {
+  QueueFamilyIndices indices = findPhysicalQueueFamilies();
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+  return queueFamilies[indices.graphicsFamily].timestampValidBits;
+}
+
 SwapChainSupportDetails TvDevice::querySwapChainSupport(VkPhysicalDevice device) {
   SwapChainSupportDetails details;
   vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface_, &details.capabilities);
@@ -393,16 +598,17 @@ VkFormat TvDevice::findSupportedFormat(
 }
 
 uint32_t TvDevice::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties memProperties;
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-    if ((typeFilter & (1 << i)) &&
-        (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-      return i;
-    }
+  uint32_t typeIndex;
+  if (!tryFindMemoryType(typeFilter, properties, typeIndex)) {
+    throw std::runtime_error("failed to find suitable memory type!");
   }
+  return typeIndex;
+}
 
-  throw std::runtime_error("failed to find suitable memory type!");
+bool TvDevice::tryFindMemoryType(
+    uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &typeIndex) {
+  // the allocator queried the memory properties once at startup
+  return allocator_->tryFindMemoryType(typeFilter, properties, typeIndex);
 }
 
 void TvDevice::createBuffer(
@@ -410,7 +616,7 @@ void TvDevice::createBuffer(
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkBuffer &buffer,
-    VkDeviceMemory &bufferMemory) {
+    TvAllocation &allocation) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -421,19 +627,33 @@ void TvDevice::createBuffer(
     throw std::runtime_error("failed to create vertex buffer!");
   }
 
-  VkMemoryRequirements memRequirements;
-  vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate vertex buffer memory!");
+  // the driver tells us if it would rather this buffer had memory to itself
+  VkMemoryDedicatedRequirements dedicatedRequirements{};
+  dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+  VkMemoryRequirements2 memRequirements{};
+  memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+  memRequirements.pNext = &dedicatedRequirements;
+  VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+  requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+  requirementsInfo.buffer = buffer;
+  vkGetBufferMemoryRequirements2(device_, &requirementsInfo, &memRequirements);
+
+  bool dedicated = dedicatedRequirements.prefersDedicatedAllocation ||
+                   dedicatedRequirements.requiresDedicatedAllocation;
+  allocation = allocator_->allocate(
+      memRequirements.memoryRequirements,
+      properties,
+      TvAllocator::ResourceKind::Linear,
+      dedicated ? buffer : VK_NULL_HANDLE);
+
+  if (vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+    throw std::runtime_error("failed to bind buffer memory!");
   }
+}
 
-  vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+void TvDevice::destroyBuffer(VkBuffer buffer, TvAllocation &allocation) {
+  vkDestroyBuffer(device_, buffer, nullptr);
+  allocator_->free(allocation);
 }
 
 VkCommandBuffer TvDevice::beginSingleTimeCommands() {
@@ -462,9 +682,19 @@ void TvDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue_);
+  // wait for just this submission, not everything else on the queue (like frames in flight)
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  VkFence fence;
+  if (vkCreateFence(device_, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+    vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
+    throw std::runtime_error("failed to create single time command fence!");
+  }
+
+  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, fence);
+  vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
 
+  vkDestroyFence(device_, fence, nullptr);
   vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
 }
 
@@ -511,26 +741,41 @@ void TvDevice::createImageWithInfo(
     const VkImageCreateInfo &imageInfo,
     VkMemoryPropertyFlags properties,
     VkImage &image,
-    VkDeviceMemory &imageMemory) {
+    TvAllocation &allocation) {
   if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
     throw std::runtime_error("failed to create image!");
   }
 
-  VkMemoryRequirements memRequirements;
-  vkGetImageMemoryRequirements(device_, image, &memRequirements);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
-  }
-
-  if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+  // render targets are the usual case for preferring a dedicated allocation
+  VkMemoryDedicatedRequirements dedicatedRequirements{};
+  dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+  VkMemoryRequirements2 memRequirements{};
+  memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+  memRequirements.pNext = &dedicatedRequirements;
+  VkImageMemoryRequirementsInfo2 requirementsInfo{};
+  requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+  requirementsInfo.image = image;
+  vkGetImageMemoryRequirements2(device_, &requirementsInfo, &memRequirements);
+
+  bool dedicated = dedicatedRequirements.prefersDedicatedAllocation ||
+                   dedicatedRequirements.requiresDedicatedAllocation;
+  // linear tiled images count as linear resources as far as bufferImageGranularity goes
+  allocation = allocator_->allocate(
+      memRequirements.memoryRequirements,
+      properties,
+      imageInfo.tiling == VK_IMAGE_TILING_LINEAR ? TvAllocator::ResourceKind::Linear
+                                                 : TvAllocator::ResourceKind::Optimal,
+      VK_NULL_HANDLE,
+      dedicated ? image : VK_NULL_HANDLE);
+
+  if (vkBindImageMemory(device_, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
     throw std::runtime_error("failed to bind image memory!");
   }
 }
 
+void TvDevice::destroyImage(VkImage image, TvAllocation &allocation) {
+  vkDestroyImage(device_, image, nullptr);
+  allocator_->free(allocation);
+}
+
 }  // namespace lve
\ No newline at end of file
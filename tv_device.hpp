@@ -1,8 +1,12 @@
 #pragma once
 
 #include "tv_window.hpp"
+#include "tv_allocator.hpp"
+#include "tv_shader_registry.hpp"
+#include "tv_pipeline_layout.hpp"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -17,13 +21,27 @@ struct SwapChainSupportDetails {
 };
 
 struct QueueFamilyIndices {
+  // graphics and compute
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  // a transfer only family (dma engine) if the device has one, the graphics family otherwise
+  uint32_t transferFamily;
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
+  bool hasDedicatedTransferFamily = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
+// VK_EXT_extended_dynamic_state entry points, all null when the device doesn't have it
+struct ExtendedDynamicStateFunctions {
+  PFN_vkCmdSetCullModeEXT cmdSetCullMode = nullptr;
+  PFN_vkCmdSetFrontFaceEXT cmdSetFrontFace = nullptr;
+  PFN_vkCmdSetPrimitiveTopologyEXT cmdSetPrimitiveTopology = nullptr;
+  PFN_vkCmdSetDepthTestEnableEXT cmdSetDepthTestEnable = nullptr;
+  PFN_vkCmdSetDepthWriteEnableEXT cmdSetDepthWriteEnable = nullptr;
+  PFN_vkCmdSetDepthCompareOpEXT cmdSetDepthCompareOp = nullptr;
+};
+
 class TvDevice {
  public:
 #ifdef NDEBUG
@@ -46,20 +64,48 @@ class TvDevice {
   VkSurfaceKHR surface() { return surface_; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
+  // same as graphicsQueue() unless the device has a transfer only queue family
+  VkQueue transferQueue() { return transferQueue_; }
+  bool isHeadless() { return window.isHeadless(); }
+  // cull mode, front face, topology and depth test/write/compare can be set while recording instead of
+  // being baked into the pipeline (enabled whenever the device supports it)
+  bool supportsExtendedDynamicState() { return extendedDynamicState_.cmdSetCullMode != nullptr; }
+  const ExtendedDynamicStateFunctions &extendedDynamicState() { return extendedDynamicState_; }
+  // pipelines can be built from separately compiled parts and linked quickly (VK_EXT_graphics_pipeline_library,
+  // only enabled when the driver does fast unoptimized links)
+  bool supportsGraphicsPipelineLibrary() { return graphicsPipelineLibrary_; }
+  // one vkCmdDrawIndexedIndirect can do many draws, and their firstInstance can be anything
+  // (multiDrawIndirect + drawIndirectFirstInstance)
+  bool supportsMultiDrawIndirect() { return multiDrawIndirect_; }
+  // the draw count of an indirect draw can come from a buffer (vkCmdDrawIndexedIndirectCount)
+  bool supportsDrawIndirectCount() { return drawIndirectCount_; }
 
   SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+  // same as findMemoryType but for optional properties, returns false instead of throwing
+  bool tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &typeIndex);
+  TvAllocator &allocator() { return *allocator_; }
+  // shared, deduplicated shader modules for every pipeline on this device
+  TvShaderRegistry &shaderModules() { return *shaderRegistry_; }
+  // shared, deduplicated pipeline and descriptor set layouts
+  TvLayoutCache &layouts() { return *layoutCache_; }
   QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
+  // 0 means the graphics queue can't do timestamp queries
+  uint32_t getGraphicsQueueTimestampBits();
   VkFormat findSupportedFormat(
       const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
   // Buffer Helper Functions
+  // memory comes from the sub-allocator, so bind/map at allocation.offset and give it back with destroyBuffer
   void createBuffer(
       VkDeviceSize size,
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkBuffer &buffer,
-      VkDeviceMemory &bufferMemory);
+      TvAllocation &allocation);
+  void destroyBuffer(VkBuffer buffer, TvAllocation &allocation);
+  // blocking one-off commands, fine for setup but anything that loads assets should go through
+  // TvUploadManager instead
   VkCommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
   void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -70,7 +116,8 @@ class TvDevice {
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
       VkImage &image,
-      VkDeviceMemory &imageMemory);
+      TvAllocation &allocation);
+  void destroyImage(VkImage image, TvAllocation &allocation);
 
   VkPhysicalDeviceProperties properties;
 
@@ -81,6 +128,7 @@ class TvDevice {
   void pickPhysicalDevice();
   void createLogicalDevice();
   void createCommandPool();
+  void createAllocator();
 
   // helper functions
   bool isDeviceSuitable(VkPhysicalDevice device);
@@ -90,6 +138,10 @@ class TvDevice {
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
   void hasGflwRequiredInstanceExtensions();
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  bool hasDeviceExtension(VkPhysicalDevice device, const char *name);
+  bool hasExtendedDynamicStateSupport(VkPhysicalDevice device);
+  bool hasGraphicsPipelineLibrarySupport(VkPhysicalDevice device);
+  std::vector<const char *> getRequiredDeviceExtensions();
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
   VkInstance instance;
@@ -97,11 +149,19 @@ class TvDevice {
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
   TvWindow &window;
   VkCommandPool commandPool;
+  std::unique_ptr<TvAllocator> allocator_;
+  std::unique_ptr<TvShaderRegistry> shaderRegistry_;
+  std::unique_ptr<TvLayoutCache> layoutCache_;
 
   VkDevice device_;
-  VkSurfaceKHR surface_;
+  VkSurfaceKHR surface_ = VK_NULL_HANDLE;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  VkQueue transferQueue_;
+  ExtendedDynamicStateFunctions extendedDynamicState_;
+  bool graphicsPipelineLibrary_ = false;
+  bool multiDrawIndirect_ = false;
+  bool drawIndirectCount_ = false;
 
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
   const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
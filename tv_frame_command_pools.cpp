@@ -0,0 +1,90 @@
+#include "tv_frame_command_pools.hpp"
+
+// std
+#include <stdexcept>
+
+namespace tv
+{
+	TvFrameCommandPools::TvFrameCommandPools(TvDevice& device, uint32_t framesInFlight, uint32_t workerCount)
+		: tvDevice{ device }, framePools(framesInFlight, std::vector<ThreadPool>(1 + workerCount))
+	{
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = tvDevice.findPhysicalQueueFamilies().graphicsFamily;
+		// no RESET_COMMAND_BUFFER_BIT on purpose, buffers only ever get reset with the whole pool
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		for (auto& threadPools : framePools)
+		{
+			for (auto& threadPool : threadPools)
+			{
+				if (vkCreateCommandPool(tvDevice.device(), &poolInfo, nullptr, &threadPool.pool) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create frame command pool");
+				}
+			}
+		}
+	}
+
+	TvFrameCommandPools::~TvFrameCommandPools()
+	{
+		// destroying a pool frees everything allocated from it
+		for (auto& threadPools : framePools)
+		{
+			for (auto& threadPool : threadPools)
+			{
+				vkDestroyCommandPool(tvDevice.device(), threadPool.pool, nullptr);
+			}
+		}
+	}
+
+	void TvFrameCommandPools::beginFrame(uint32_t frameIndex)
+	{
+		currentFrameIndex = frameIndex;
+
+		// hands the memory back to the pool instead of the driver (no RELEASE_RESOURCES_BIT), next frame wants about the same amount anyway
+		for (auto& threadPool : framePools[frameIndex])
+		{
+			if (vkResetCommandPool(tvDevice.device(), threadPool.pool, 0) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to reset frame command pool");
+			}
+			threadPool.primariesUsed = 0;
+			threadPool.secondariesUsed = 0;
+		}
+	}
+
+	VkCommandBuffer TvFrameCommandPools::allocatePrimary()
+	{
+		return allocate(framePools[currentFrameIndex][0], VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	}
+
+	VkCommandBuffer TvFrameCommandPools::allocateSecondary(uint32_t workerIndex)
+	{
+		return allocate(framePools[currentFrameIndex][1 + workerIndex], VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+	}
+
+	VkCommandBuffer TvFrameCommandPools::allocate(ThreadPool& threadPool, VkCommandBufferLevel level)
+	{
+		const bool primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		std::vector<VkCommandBuffer>& buffers = primary ? threadPool.primaries : threadPool.secondaries;
+		size_t& used = primary ? threadPool.primariesUsed : threadPool.secondariesUsed;
+
+		if (used == buffers.size())
+		{
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = level;
+			allocInfo.commandPool = threadPool.pool;
+			allocInfo.commandBufferCount = 1;
+
+			VkCommandBuffer commandBuffer;
+			if (vkAllocateCommandBuffers(tvDevice.device(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate frame command buffer");
+			}
+			buffers.push_back(commandBuffer);
+		}
+		return buffers[used++];
+	}
+}
\ No newline at end of file
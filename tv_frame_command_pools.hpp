@@ -0,0 +1,47 @@
+#pragma once
+#include "tv_device.hpp"
+
+// std
+#include <vector>
+
+namespace tv
+{
+	// Transient command pools, one per frame in flight for the main thread plus one per frame per recording worker
+	// Command buffers get re-recorded every frame, and instead of resetting/freeing them one at a time the frame's
+	// pools get reset in one go once the frame that last used them has retired. The buffers themselves are kept around and handed out again.
+	// Pools are externally synchronized, so each worker only ever allocates/records from its own.
+	class TvFrameCommandPools
+	{
+	public:
+		TvFrameCommandPools(TvDevice& device, uint32_t framesInFlight, uint32_t workerCount = 0);
+		~TvFrameCommandPools();
+
+		TvFrameCommandPools(const TvFrameCommandPools&) = delete;
+		void operator=(const TvFrameCommandPools&) = delete;
+
+		// resets the pools for this frame index, the frame that last used it must have retired (see TvFrameTimeline::waitForFrameSlot)
+		// and no worker can be recording right now
+		void beginFrame(uint32_t frameIndex);
+		// a primary command buffer from the current frame's main thread pool, ready to record, only good until this frame index comes around again
+		VkCommandBuffer allocatePrimary();
+		// same thing but a secondary from a worker's own pool, safe to call from that worker while the others do the same
+		VkCommandBuffer allocateSecondary(uint32_t workerIndex);
+	private:
+		struct ThreadPool
+		{
+			VkCommandPool pool = VK_NULL_HANDLE;
+			// everything ever allocated from the pool, the first `...Used` are in use this frame
+			std::vector<VkCommandBuffer> primaries;
+			std::vector<VkCommandBuffer> secondaries;
+			size_t primariesUsed = 0;
+			size_t secondariesUsed = 0;
+		};
+
+		VkCommandBuffer allocate(ThreadPool& threadPool, VkCommandBufferLevel level);
+
+		TvDevice& tvDevice;
+		// [frame index][0 = main thread, 1 + worker index]
+		std::vector<std::vector<ThreadPool>> framePools;
+		uint32_t currentFrameIndex = 0;
+	};
+}
\ No newline at end of file
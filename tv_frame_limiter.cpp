@@ -0,0 +1,87 @@
+#include "tv_frame_limiter.hpp"
+
+// std
+#include <thread>
+
+// windows sleeps in 15.6ms steps by default, which is useless for this, so ask for 1ms timer resolution while we're around
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+namespace tv
+{
+	TvFrameLimiter::TvFrameLimiter(double framesPerSecond)
+	{
+#ifdef _WIN32
+		timeBeginPeriod(1);
+#endif
+		setTarget(framesPerSecond);
+	}
+
+	TvFrameLimiter::~TvFrameLimiter()
+	{
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	void TvFrameLimiter::setTarget(double framesPerSecond)
+	{
+		if (framesPerSecond > 0.0)
+		{
+			period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+		}
+		else
+		{
+			period = Clock::duration{ 0 };
+		}
+		started = false;
+	}
+
+	double TvFrameLimiter::target() const
+	{
+		return isEnabled() ? 1.0 / std::chrono::duration<double>(period).count() : 0.0;
+	}
+
+	double TvFrameLimiter::wait()
+	{
+		if (!isEnabled())
+		{
+			return 0.0;
+		}
+
+		auto start = Clock::now();
+		if (!started)
+		{
+			// first frame goes right away, everything after is spaced from it
+			started = true;
+			nextFrame = start + period;
+			return 0.0;
+		}
+
+		if (start < nextFrame)
+		{
+			if (nextFrame - start > SPIN_MARGIN)
+			{
+				std::this_thread::sleep_for(nextFrame - start - SPIN_MARGIN);
+			}
+			while (Clock::now() < nextFrame)
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		// step the deadline (instead of now + period) so the average rate doesn't drift, unless we've fallen a whole
+		// frame behind (a hitch, a resize...), then don't try to catch up with a burst of frames
+		auto now = Clock::now();
+		nextFrame += period;
+		if (now > nextFrame)
+		{
+			nextFrame = now + period;
+		}
+		return std::chrono::duration<double, std::milli>(now - start).count();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+// std
+#include <chrono>
+
+namespace tv
+{
+	// Caps how often frames get started, so mailbox/immediate (which never block on present) don't spin a core
+	// rendering frames nobody sees. Sleeps for most of the gap and spins for the last bit since sleeps overshoot.
+	class TvFrameLimiter
+	{
+	public:
+		// 0 means unlimited
+		explicit TvFrameLimiter(double framesPerSecond = 0.0);
+		~TvFrameLimiter();
+
+		TvFrameLimiter(const TvFrameLimiter&) = delete;
+		void operator=(const TvFrameLimiter&) = delete;
+
+		void setTarget(double framesPerSecond);
+		bool isEnabled() const { return period.count() > 0; }
+		double target() const;
+
+		// blocks until the next frame is due and returns how long that took (ms), call once at the start of every frame
+		double wait();
+	private:
+		using Clock = std::chrono::steady_clock;
+		// how close to the deadline we stop trusting sleep and spin instead
+		static constexpr std::chrono::microseconds SPIN_MARGIN{ 1500 };
+
+		Clock::duration period{ 0 };
+		Clock::time_point nextFrame;
+		bool started = false;
+	};
+}
\ No newline at end of file
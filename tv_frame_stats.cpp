@@ -0,0 +1,354 @@
+#include "tv_frame_stats.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace tv
+{
+	namespace
+	{
+		// every field we keep, so the summary and both exporters stay in sync
+		struct FieldInfo
+		{
+			const char* name;
+			double FrameRecord::* field;
+		};
+
+		struct CountFieldInfo
+		{
+			const char* name;
+			int64_t FrameRecord::* field;
+		};
+
+		const FieldInfo frameFields[] =
+		{
+			{ "limiterMs", &FrameRecord::limiterMs },
+			{ "frameWaitMs", &FrameRecord::frameWaitMs },
+			{ "acquireMs", &FrameRecord::acquireMs },
+			{ "imageWaitMs", &FrameRecord::imageWaitMs },
+			{ "submitMs", &FrameRecord::submitMs },
+			{ "presentMs", &FrameRecord::presentMs },
+			{ "recordMs", &FrameRecord::recordMs },
+			{ "cpuFrameMs", &FrameRecord::cpuFrameMs },
+			{ "gpuMs", &FrameRecord::gpuMs },
+		};
+
+		const CountFieldInfo countFields[] =
+		{
+			{ "objectsTested", &FrameRecord::objectsTested },
+			{ "objectsCulled", &FrameRecord::objectsCulled },
+			{ "objectsDrawn", &FrameRecord::objectsDrawn },
+		};
+
+		// nearest rank percentile of an already sorted list
+		double percentile(const std::vector<double>& sorted, double p)
+		{
+			size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+			return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+		}
+
+		TvFrameStats::Summary summarizeValues(std::vector<double>& values)
+		{
+			TvFrameStats::Summary summary{};
+			if (values.empty())
+			{
+				return summary;
+			}
+			std::sort(values.begin(), values.end());
+			summary.count = values.size();
+			summary.p50 = percentile(values, 50.0);
+			summary.p95 = percentile(values, 95.0);
+			summary.p99 = percentile(values, 99.0);
+			return summary;
+		}
+	}
+
+	TvFrameStats::TvFrameStats(size_t capacity) : records(std::max<size_t>(capacity, 1))
+	{
+	}
+
+	FrameRecord& TvFrameStats::beginFrame(uint64_t frame)
+	{
+		FrameRecord& record = records[next];
+		record = FrameRecord{};
+		record.frame = frame;
+
+		next = (next + 1) % records.size();
+		count = std::min(count + 1, records.size());
+		return record;
+	}
+
+	FrameRecord* TvFrameStats::find(uint64_t frame)
+	{
+		// frames are recorded in order, so the distance from the newest one tells us where it lives
+		if (count == 0)
+		{
+			return nullptr;
+		}
+		size_t newest = (next + records.size() - 1) % records.size();
+		uint64_t newestFrame = records[newest].frame;
+		if (frame > newestFrame || newestFrame - frame >= count)
+		{
+			return nullptr;
+		}
+		size_t index = (newest + records.size() - static_cast<size_t>(newestFrame - frame)) % records.size();
+		return records[index].frame == frame ? &records[index] : nullptr;
+	}
+
+	std::vector<const FrameRecord*> TvFrameStats::ordered() const
+	{
+		std::vector<const FrameRecord*> result;
+		result.reserve(count);
+		size_t first = (next + records.size() - count) % records.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			result.push_back(&records[(first + i) % records.size()]);
+		}
+		return result;
+	}
+
+	TvFrameStats::Summary TvFrameStats::summarize(double FrameRecord::* field) const
+	{
+		std::vector<double> values;
+		values.reserve(count);
+		for (const FrameRecord* record : ordered())
+		{
+			if (record->*field >= 0.0)
+			{
+				values.push_back(record->*field);
+			}
+		}
+		return summarizeValues(values);
+	}
+
+	TvFrameStats::Summary TvFrameStats::summarize(int64_t FrameRecord::* field) const
+	{
+		// nearest rank never interpolates, so the percentiles are still whole counts
+		std::vector<double> values;
+		values.reserve(count);
+		for (const FrameRecord* record : ordered())
+		{
+			if (record->*field >= 0)
+			{
+				values.push_back(static_cast<double>(record->*field));
+			}
+		}
+		return summarizeValues(values);
+	}
+
+	void TvFrameStats::printSummary(std::ostream& out) const
+	{
+		out << "frame stats over the last " << count << " frames (times in ms, p50 / p95 / p99):" << std::endl;
+		for (const auto& info : frameFields)
+		{
+			Summary summary = summarize(info.field);
+			if (summary.count == 0)
+			{
+				out << "\t" << std::setw(14) << std::left << info.name << "n/a" << std::endl;
+				continue;
+			}
+			out << "\t" << std::setw(14) << std::left << info.name << std::fixed << std::setprecision(3)
+				<< summary.p50 << " / " << summary.p95 << " / " << summary.p99 << std::endl;
+		}
+		out << std::defaultfloat;
+
+		// only there when something was culled
+		bool header = false;
+		for (const auto& info : countFields)
+		{
+			Summary summary = summarize(info.field);
+			if (summary.count == 0)
+			{
+				continue;
+			}
+			if (!header)
+			{
+				out << "culling over the last " << summary.count << " frames (objects per frame, p50 / p95 / p99):" << std::endl;
+				header = true;
+			}
+			out << "\t" << std::setw(14) << std::left << info.name << static_cast<int64_t>(summary.p50) << " / "
+				<< static_cast<int64_t>(summary.p95) << " / " << static_cast<int64_t>(summary.p99) << std::endl;
+		}
+	}
+
+	void TvFrameStats::writeCsv(const std::string& filepath) const
+	{
+		std::ofstream file{ filepath };
+		if (!file.is_open())
+		{
+			throw std::runtime_error("failed to open file: " + filepath);
+		}
+
+		file << "frame";
+		for (const auto& info : frameFields)
+		{
+			file << "," << info.name;
+		}
+		for (const auto& info : countFields)
+		{
+			file << "," << info.name;
+		}
+		file << "\n";
+
+		for (const FrameRecord* record : ordered())
+		{
+			file << record->frame;
+			for (const auto& info : frameFields)
+			{
+				file << "," << record->*info.field;
+			}
+			for (const auto& info : countFields)
+			{
+				file << "," << record->*info.field;
+			}
+			file << "\n";
+		}
+	}
+
+	void TvFrameStats::writeJson(const std::string& filepath) const
+	{
+		std::ofstream file{ filepath };
+		if (!file.is_open())
+		{
+			throw std::runtime_error("failed to open file: " + filepath);
+		}
+
+		// unknown values (negative) go out as null so nobody averages them by accident
+		auto writeValue = [&file](auto value)
+		{
+			if (value < 0.0)
+			{
+				file << "null";
+			}
+			else
+			{
+				file << value;
+			}
+		};
+
+		file << "{\n\t\"summary\": {";
+		bool firstField = true;
+		for (const auto& info : frameFields)
+		{
+			Summary summary = summarize(info.field);
+			file << (firstField ? "\n" : ",\n") << "\t\t\"" << info.name << "\": { \"count\": " << summary.count
+				<< ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << " }";
+			firstField = false;
+		}
+		for (const auto& info : countFields)
+		{
+			Summary summary = summarize(info.field);
+			file << (firstField ? "\n" : ",\n") << "\t\t\"" << info.name << "\": { \"count\": " << summary.count
+				<< ", \"p50\": " << static_cast<int64_t>(summary.p50) << ", \"p95\": " << static_cast<int64_t>(summary.p95)
+				<< ", \"p99\": " << static_cast<int64_t>(summary.p99) << " }";
+			firstField = false;
+		}
+		file << "\n\t},\n\t\"frames\": [";
+
+		bool firstRecord = true;
+		for (const FrameRecord* record : ordered())
+		{
+			file << (firstRecord ? "\n" : ",\n") << "\t\t{ \"frame\": " << record->frame;
+			for (const auto& info : frameFields)
+			{
+				file << ", \"" << info.name << "\": ";
+				writeValue(record->*info.field);
+			}
+			for (const auto& info : countFields)
+			{
+				file << ", \"" << info.name << "\": ";
+				writeValue(record->*info.field);
+			}
+			file << " }";
+			firstRecord = false;
+		}
+		file << "\n\t]\n}\n";
+	}
+
+	TvGpuTimer::TvGpuTimer(TvDevice& device, uint32_t slotCount) : tvDevice{ device }, slotCount{ slotCount }
+	{
+		// timestampValidBits == 0 means the graphics queue can't write timestamps at all
+		uint32_t validBits = device.getGraphicsQueueTimestampBits();
+		if (validBits == 0 || slotCount == 0)
+		{
+			return;
+		}
+		if (validBits < 64)
+		{
+			timestampMask = (1ull << validBits) - 1;
+		}
+		timestampPeriod = static_cast<double>(device.properties.limits.timestampPeriod);
+
+		// two queries (begin and end) per slot
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = slotCount * 2;
+
+		if (vkCreateQueryPool(tvDevice.device(), &poolInfo, nullptr, &queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool");
+		}
+	}
+
+	TvGpuTimer::~TvGpuTimer()
+	{
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(tvDevice.device(), queryPool, nullptr);
+		}
+	}
+
+	void TvGpuTimer::writeBegin(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		if (!isSupported())
+		{
+			return;
+		}
+		vkCmdResetQueryPool(commandBuffer, queryPool, slot * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, slot * 2);
+	}
+
+	void TvGpuTimer::writeEnd(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		if (!isSupported())
+		{
+			return;
+		}
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, slot * 2 + 1);
+	}
+
+	bool TvGpuTimer::read(uint32_t slot, double& elapsedMs)
+	{
+		if (!isSupported() || slot >= slotCount)
+		{
+			return false;
+		}
+
+		// each query comes back as { value, availability }
+		uint64_t results[4] = {};
+		VkResult result = vkGetQueryPoolResults(
+			tvDevice.device(),
+			queryPool,
+			slot * 2,
+			2,
+			sizeof(results),
+			results,
+			sizeof(uint64_t) * 2,
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		if ((result != VK_SUCCESS && result != VK_NOT_READY) || results[1] == 0 || results[3] == 0)
+		{
+			return false;
+		}
+
+		uint64_t begin = results[0] & timestampMask;
+		uint64_t end = results[2] & timestampMask;
+		elapsedMs = static_cast<double>((end - begin) & timestampMask) * timestampPeriod / 1e6;
+		return true;
+	}
+}
\ No newline at end of file
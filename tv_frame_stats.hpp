@@ -0,0 +1,95 @@
+#pragma once
+#include "tv_device.hpp"
+
+// std
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace tv
+{
+	// Everything we measured about a single frame, times in milliseconds and counts of objects
+	// gpuMs (and the culling counts) stay negative until that frame's results come back (or forever if the queue can't
+	// do timestamps or nothing is culled)
+	struct FrameRecord
+	{
+		uint64_t frame = 0;
+		double limiterMs = 0.0;		// held back by the frame limiter
+		double frameWaitMs = 0.0;	// blocked on the frame timeline for a free frame slot
+		double acquireMs = 0.0;		// vkAcquireNextImageKHR
+		double imageWaitMs = 0.0;	// blocked on whatever frame was still using the acquired image
+		double submitMs = 0.0;		// vkQueueSubmit
+		double presentMs = 0.0;		// vkQueuePresentKHR
+		double recordMs = 0.0;		// recording the frame's command buffers (wall clock, across all recording threads)
+		double cpuFrameMs = 0.0;	// whole drawFrame, start to finish
+		double gpuMs = -1.0;		// time between the timestamps around the render pass
+		int64_t objectsTested = -1;	// objects the gpu culling looked at
+		int64_t objectsCulled = -1;	// thrown away by the frustum or occlusion test
+		int64_t objectsDrawn = -1;	// left for the indirect draws
+	};
+
+	// Fixed size ring of the last N frame records with percentile summaries and CSV/JSON dumps
+	class TvFrameStats
+	{
+	public:
+		struct Summary
+		{
+			size_t count = 0;
+			double p50 = 0.0;
+			double p95 = 0.0;
+			double p99 = 0.0;
+		};
+
+		explicit TvFrameStats(size_t capacity = 2048);
+
+		// starts a new record (overwriting the oldest one once the ring is full)
+		FrameRecord& beginFrame(uint64_t frame);
+		// returns the record for a frame if it hasn't been overwritten yet
+		FrameRecord* find(uint64_t frame);
+
+		// percentiles of one field over every record in the ring, negative (unknown) values are skipped
+		Summary summarize(double FrameRecord::* field) const;
+		Summary summarize(int64_t FrameRecord::* field) const;
+
+		void printSummary(std::ostream& out) const;
+		void writeCsv(const std::string& filepath) const;
+		void writeJson(const std::string& filepath) const;
+	private:
+		// records in the order they were recorded, oldest first
+		std::vector<const FrameRecord*> ordered() const;
+
+		std::vector<FrameRecord> records;
+		size_t next = 0;
+		size_t count = 0;
+	};
+
+	// Timestamp queries around a chunk of a command buffer, one begin/end pair per slot
+	// (a slot is whatever the command buffers are indexed by, we can only read a slot back once the gpu is done with it)
+	class TvGpuTimer
+	{
+	public:
+		TvGpuTimer(TvDevice& device, uint32_t slotCount);
+		~TvGpuTimer();
+
+		TvGpuTimer(const TvGpuTimer&) = delete;
+		void operator=(const TvGpuTimer&) = delete;
+
+		// false if the graphics queue has no timestamp support, all the calls below are no-ops then
+		bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+
+		// must be recorded outside a render pass (it resets the slot's queries)
+		void writeBegin(VkCommandBuffer commandBuffer, uint32_t slot);
+		void writeEnd(VkCommandBuffer commandBuffer, uint32_t slot);
+
+		// gets the elapsed gpu time for a slot without blocking, returns false if it isn't available (yet)
+		bool read(uint32_t slot, double& elapsedMs);
+	private:
+		TvDevice& tvDevice;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		uint32_t slotCount;
+		// nanoseconds per timestamp tick
+		double timestampPeriod = 1.0;
+		uint64_t timestampMask = ~0ull;
+	};
+}
\ No newline at end of file
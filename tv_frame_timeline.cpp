@@ -0,0 +1,96 @@
+#include "tv_frame_timeline.hpp"
+
+// std
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace tv
+{
+	TvFrameTimeline::TvFrameTimeline(TvDevice& device, uint32_t framesInFlight)
+		: tvDevice{ device }, frameCount{ std::min(std::max(framesInFlight, 1u), MAX_FRAMES_IN_FLIGHT) }
+	{
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+
+		if (vkCreateSemaphore(tvDevice.device(), &semaphoreInfo, nullptr, &timelineSemaphore) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame timeline semaphore");
+		}
+	}
+
+	TvFrameTimeline::~TvFrameTimeline()
+	{
+		waitForFrame(lastSubmittedFrame());
+		collectRetired();
+		vkDestroySemaphore(tvDevice.device(), timelineSemaphore, nullptr);
+	}
+
+	void TvFrameTimeline::waitForFrameSlot()
+	{
+		// frames 1..framesInFlight have nobody to wait on
+		if (nextFrame > frameCount)
+		{
+			waitForFrame(nextFrame - frameCount);
+		}
+		collectRetired();
+	}
+
+	uint64_t TvFrameTimeline::completedFrame()
+	{
+		uint64_t value = 0;
+		if (vkGetSemaphoreCounterValue(tvDevice.device(), timelineSemaphore, &value) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to read frame timeline value");
+		}
+		completed = std::max(completed, value);
+		return completed;
+	}
+
+	bool TvFrameTimeline::isFrameRetired(uint64_t frame)
+	{
+		return frame <= completed || frame <= completedFrame();
+	}
+
+	void TvFrameTimeline::waitForFrame(uint64_t frame)
+	{
+		if (frame == 0 || frame <= completed)
+		{
+			return;
+		}
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &timelineSemaphore;
+		waitInfo.pValues = &frame;
+
+		if (vkWaitSemaphores(tvDevice.device(), &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to wait for frame timeline");
+		}
+		completed = std::max(completed, frame);
+	}
+
+	void TvFrameTimeline::deferUntilRetired(std::function<void()> fn)
+	{
+		deferred.emplace_back(lastSubmittedFrame(), std::move(fn));
+	}
+
+	void TvFrameTimeline::collectRetired()
+	{
+		// deferred work is queued in frame order, so stop at the first thing that's still in use
+		while (!deferred.empty() && isFrameRetired(deferred.front().first))
+		{
+			auto fn = std::move(deferred.front().second);
+			deferred.pop_front();
+			fn();
+		}
+	}
+}
\ No newline at end of file
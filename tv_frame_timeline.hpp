@@ -0,0 +1,62 @@
+#pragma once
+#include "tv_device.hpp"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+
+namespace tv
+{
+	// Frame pacing on a single timeline semaphore
+	// Every submitted frame signals the semaphore with its own frame number (starting at 1), so "has frame N retired"
+	// is just "is the counter >= N", no per-frame fences needed. Frame N can start once frame N - framesInFlight retired.
+	class TvFrameTimeline
+	{
+	public:
+		// 1 is lowest latency, 3 trades a frame of latency for throughput
+		static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+		TvFrameTimeline(TvDevice& device, uint32_t framesInFlight);
+		// waits for everything submitted and runs whatever was still deferred
+		~TvFrameTimeline();
+
+		TvFrameTimeline(const TvFrameTimeline&) = delete;
+		void operator=(const TvFrameTimeline&) = delete;
+
+		VkSemaphore semaphore() const { return timelineSemaphore; }
+		uint32_t framesInFlight() const { return frameCount; }
+
+		// the frame number the next submission signals
+		uint64_t currentFrame() const { return nextFrame; }
+		// which per-frame resources (command buffers, semaphores, ...) the current frame gets to use
+		uint32_t frameIndex() const { return static_cast<uint32_t>(nextFrame % frameCount); }
+		// 0 if nothing has been submitted yet
+		uint64_t lastSubmittedFrame() const { return nextFrame - 1; }
+
+		// blocks until the frame that last used the current frame index has retired, then runs anything deferred that's now safe
+		void waitForFrameSlot();
+		// moves on to the next frame, call once the current frame's submission (which signals currentFrame()) is queued
+		void frameSubmitted() { nextFrame++; }
+
+		// the newest frame the gpu has finished
+		uint64_t completedFrame();
+		bool isFrameRetired(uint64_t frame);
+		void waitForFrame(uint64_t frame);
+
+		// runs fn once every frame submitted so far has retired (for freeing things the gpu might still be using)
+		void deferUntilRetired(std::function<void()> fn);
+		// runs any deferred work whose frames have retired
+		void collectRetired();
+	private:
+		TvDevice& tvDevice;
+		VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+		uint32_t frameCount;
+		uint64_t nextFrame = 1;
+		// cached so isFrameRetired doesn't have to ask the driver every time
+		uint64_t completed = 0;
+
+		std::deque<std::pair<uint64_t, std::function<void()>>> deferred;
+	};
+}
\ No newline at end of file
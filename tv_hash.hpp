@@ -0,0 +1,21 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace tv
+{
+	// FNV-1a, fast and good enough for telling files/blobs apart (not for anything security related)
+	// pass the last result back in as hash to keep hashing more data
+	inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
\ No newline at end of file
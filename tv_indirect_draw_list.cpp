@@ -0,0 +1,108 @@
+#include "tv_indirect_draw_list.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+namespace tv
+{
+	TvIndirectDrawList::TvIndirectDrawList(TvDevice& device, TvUploadManager& uploads, TvModel& model, const std::vector<Object>& objects)
+		: tvDevice{ device }, model{ model }, count{ static_cast<uint32_t>(objects.size()) }
+	{
+		if (!tvDevice.supportsMultiDrawIndirect())
+		{
+			throw std::runtime_error("indirect draw lists need multiDrawIndirect and drawIndirectFirstInstance");
+		}
+		if (!model.isIndexed())
+		{
+			throw std::runtime_error("indirect draw lists need an indexed model");
+		}
+		if (count == 0 || count > tvDevice.properties.limits.maxDrawIndirectCount)
+		{
+			throw std::runtime_error("an indirect draw list needs between 1 and maxDrawIndirectCount objects");
+		}
+
+		std::vector<VkDrawIndexedIndirectCommand> commands;
+		std::vector<TvInstanceBuffer::InstanceData> instances;
+		std::vector<glm::vec4> bounds;
+		commands.reserve(count);
+		instances.reserve(count);
+		bounds.reserve(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const Object& object = objects[i];
+			commands.push_back(model.indirectCommand(object.mesh, 1, i));
+			instances.push_back(object.instance);
+
+			// the mesh's sphere moved by the object's transform and depth, scaled by its longest axis so it still covers the mesh
+			const glm::vec4 meshBounds = model.mesh(object.mesh).bounds;
+			const glm::vec2 center = object.instance.transform * glm::vec2{ meshBounds.x, meshBounds.y } + object.instance.offset;
+			const float scale = std::max(glm::length(object.instance.transform[0]), glm::length(object.instance.transform[1]));
+			bounds.push_back({ center.x, center.y, meshBounds.z + object.instance.depth, meshBounds.w * scale });
+		}
+
+		tvDevice.createBuffer(
+			sizeof(VkDrawIndexedIndirectCommand) * count,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indirectBuffer,
+			indirectAllocation);
+		uploads.uploadBuffer(indirectBuffer, 0, commands.data(), sizeof(VkDrawIndexedIndirectCommand) * count);
+
+		tvDevice.createBuffer(
+			sizeof(TvInstanceBuffer::InstanceData) * count,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			objectBuffer,
+			objectAllocation);
+		uploads.uploadBuffer(objectBuffer, 0, instances.data(), sizeof(TvInstanceBuffer::InstanceData) * count);
+
+		tvDevice.createBuffer(
+			sizeof(glm::vec4) * count,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			objectBoundsBuffer,
+			objectBoundsAllocation);
+		uploads.uploadBuffer(objectBoundsBuffer, 0, bounds.data(), sizeof(glm::vec4) * count);
+
+		tvDevice.createBuffer(
+			sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			countBuffer,
+			countAllocation);
+		uploads.uploadBuffer(countBuffer, 0, &count, sizeof(uint32_t));
+	}
+
+	TvIndirectDrawList::~TvIndirectDrawList()
+	{
+		tvDevice.destroyBuffer(countBuffer, countAllocation);
+		tvDevice.destroyBuffer(objectBoundsBuffer, objectBoundsAllocation);
+		tvDevice.destroyBuffer(objectBuffer, objectAllocation);
+		tvDevice.destroyBuffer(indirectBuffer, indirectAllocation);
+	}
+
+	void TvIndirectDrawList::bind(VkCommandBuffer commandBuffer)
+	{
+		model.bind(commandBuffer);
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, TvInstanceBuffer::BINDING, 1, &objectBuffer, &offset);
+	}
+
+	void TvIndirectDrawList::draw(VkCommandBuffer commandBuffer)
+	{
+		if (tvDevice.supportsDrawIndirectCount())
+		{
+			vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer, 0, countBuffer, 0, count, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, 0, count, sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
+
+	VkDeviceSize TvIndirectDrawList::memorySize() const
+	{
+		return indirectAllocation.size + objectAllocation.size + objectBoundsAllocation.size + countAllocation.size;
+	}
+}
\ No newline at end of file
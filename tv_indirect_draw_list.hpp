@@ -0,0 +1,64 @@
+#pragma once
+#include "tv_device.hpp"
+#include "tv_upload_manager.hpp"
+#include "tv_model.hpp"
+#include "tv_instance_buffer.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace tv
+{
+	// A scene's draws kept on the gpu: one VkDrawIndexedIndirectCommand per object and each object's data, all in device
+	// local buffers, drawn with a single indirect call against the model's merged vertex/index buffers
+	// So recording costs the same no matter how many objects there are. Object i is drawn as instance i, that's how the
+	// instanced shader finds its InstanceData (bound at TvInstanceBuffer::BINDING).
+	// Like TvModel the data goes up through the upload manager, so it's usable once the next flush's token completes.
+	// Needs TvDevice::supportsMultiDrawIndirect.
+	class TvIndirectDrawList
+	{
+	public:
+		struct Object
+		{
+			// which of the model's meshes
+			uint32_t mesh = 0;
+			TvInstanceBuffer::InstanceData instance;
+		};
+
+		// the model has to be indexed and outlive the list
+		TvIndirectDrawList(TvDevice& device, TvUploadManager& uploads, TvModel& model, const std::vector<Object>& objects);
+		~TvIndirectDrawList();
+
+		TvIndirectDrawList(const TvIndirectDrawList&) = delete;
+		void operator=(const TvIndirectDrawList&) = delete;
+
+		// binds the model and the object data
+		void bind(VkCommandBuffer commandBuffer);
+		// every object, with vkCmdDrawIndexedIndirectCount when the device has it (the count buffer holds objectCount())
+		void draw(VkCommandBuffer commandBuffer);
+
+		uint32_t objectCount() const { return count; }
+		// command + object + bounds + count buffer bytes
+		VkDeviceSize memorySize() const;
+
+		// for compute passes that pick what to draw (see TvCullingPass), both are storage buffers
+		// one VkDrawIndexedIndirectCommand per object
+		VkBuffer commandBuffer() const { return indirectBuffer; }
+		// one bounding sphere (vec4: center, radius) per object, in the space the object's transform puts it in
+		VkBuffer boundsBuffer() const { return objectBoundsBuffer; }
+	private:
+		TvDevice& tvDevice;
+		TvModel& model;
+		uint32_t count;
+
+		VkBuffer indirectBuffer = VK_NULL_HANDLE;
+		TvAllocation indirectAllocation;
+		VkBuffer objectBuffer = VK_NULL_HANDLE;
+		TvAllocation objectAllocation;
+		VkBuffer objectBoundsBuffer = VK_NULL_HANDLE;
+		TvAllocation objectBoundsAllocation;
+		VkBuffer countBuffer = VK_NULL_HANDLE;
+		TvAllocation countAllocation;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "tv_instance_buffer.hpp"
+
+// std
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+namespace tv
+{
+	static_assert(sizeof(TvInstanceBuffer::InstanceData) == 40, "InstanceData has to match the instance attributes, no padding");
+
+	TvInstanceBuffer::TvInstanceBuffer(TvDevice& device, uint32_t framesInFlight, uint32_t capacity)
+		: tvDevice{ device }, instanceCapacity{ capacity }, regionCount{ framesInFlight }
+	{
+		if (capacity == 0 || framesInFlight == 0)
+		{
+			throw std::runtime_error("an instance buffer needs room for at least one instance and frame");
+		}
+
+		// every region starts on a multiple of the stride, so the binding offsets stay aligned for the attributes
+		regionSize = sizeof(InstanceData) * static_cast<VkDeviceSize>(capacity);
+
+		// vertex buffers can live in any host visible type on the drivers we've seen, so checking the types without a
+		// buffer is good enough to pick between the two
+		const VkMemoryPropertyFlags hostFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		uint32_t typeIndex;
+		deviceLocal = tvDevice.tryFindMemoryType(~0u, hostFlags | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, typeIndex);
+
+		tvDevice.createBuffer(
+			memorySize(),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			deviceLocal ? hostFlags | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : hostFlags,
+			buffer,
+			allocation);
+		if (allocation.mapped == nullptr)
+		{
+			throw std::runtime_error("instance buffer memory isn't mapped");
+		}
+	}
+
+	TvInstanceBuffer::~TvInstanceBuffer()
+	{
+		tvDevice.destroyBuffer(buffer, allocation);
+	}
+
+	TvInstanceBuffer::InstanceData* TvInstanceBuffer::frameInstances(uint32_t frameIndex)
+	{
+		assert(frameIndex < regionCount && "frame index out of range");
+		return reinterpret_cast<InstanceData*>(static_cast<char*>(allocation.mapped) + regionSize * frameIndex);
+	}
+
+	void TvInstanceBuffer::bind(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+	{
+		assert(frameIndex < regionCount && "frame index out of range");
+		VkDeviceSize offset = regionSize * frameIndex;
+		vkCmdBindVertexBuffers(commandBuffer, BINDING, 1, &buffer, &offset);
+	}
+
+	void TvInstanceBuffer::appendInputDescriptions(std::vector<VkVertexInputBindingDescription>& bindings,
+		std::vector<VkVertexInputAttributeDescription>& attributes)
+	{
+		// a mat2 takes a location per column
+		bindings.push_back({ BINDING, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE });
+		attributes.push_back({ 2, BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(InstanceData, transform) });
+		attributes.push_back({ 3, BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(InstanceData, transform) + sizeof(glm::vec2) });
+		attributes.push_back({ 4, BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(InstanceData, offset) });
+		attributes.push_back({ 5, BINDING, VK_FORMAT_R32G32B32_SFLOAT, offsetof(InstanceData, color) });
+		attributes.push_back({ 6, BINDING, VK_FORMAT_R32_SFLOAT, offsetof(InstanceData, depth) });
+	}
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+#include "tv_device.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace tv
+{
+	// Per instance vertex attributes, rewritten by the cpu every frame
+	// There's one region per frame in flight in one persistently mapped (host coherent) buffer, so filling in this
+	// frame's instances never touches memory a frame still on the gpu is reading, and nothing has to be flushed or
+	// copied. When the device has host visible device local memory (resizable bar, integrated gpus) it goes there so
+	// the gpu doesn't read it over the bus.
+	class TvInstanceBuffer
+	{
+	public:
+		// what the instanced shaders read per instance (locations 2-6, see appendInputDescriptions)
+		struct InstanceData
+		{
+			glm::mat2 transform;
+			glm::vec2 offset;
+			// added to the vertices' z, so instances can sit in front of each other (0 is near, 1 is far)
+			float depth;
+			glm::vec3 color;
+		};
+
+		// the model's streams use bindings 0 and 1
+		static constexpr uint32_t BINDING = 2;
+
+		TvInstanceBuffer(TvDevice& device, uint32_t framesInFlight, uint32_t capacity);
+		~TvInstanceBuffer();
+
+		TvInstanceBuffer(const TvInstanceBuffer&) = delete;
+		void operator=(const TvInstanceBuffer&) = delete;
+
+		// where to write this frame's instances (capacity() of them), only once the frame index has been acquired
+		InstanceData* frameInstances(uint32_t frameIndex);
+		// binds this frame's region at BINDING, the instance index in the draw picks the element
+		void bind(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+		uint32_t capacity() const { return instanceCapacity; }
+		bool isDeviceLocal() const { return deviceLocal; }
+		VkDeviceSize memorySize() const { return regionSize * regionCount; }
+
+		// adds the per instance binding and attributes to a pipeline's vertex input state (after the model's)
+		static void appendInputDescriptions(std::vector<VkVertexInputBindingDescription>& bindings,
+			std::vector<VkVertexInputAttributeDescription>& attributes);
+	private:
+		TvDevice& tvDevice;
+		uint32_t instanceCapacity;
+		uint32_t regionCount;
+		VkDeviceSize regionSize;
+		bool deviceLocal = false;
+
+		VkBuffer buffer = VK_NULL_HANDLE;
+		TvAllocation allocation;
+	};
+}
\ No newline at end of file
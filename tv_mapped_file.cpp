@@ -0,0 +1,108 @@
+#include "tv_mapped_file.hpp"
+
+// std
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tv
+{
+#ifdef _WIN32
+	TvMappedFile::TvMappedFile(const std::string& filepath) : filepath{ filepath }
+	{
+		file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			file = nullptr;
+			throw std::runtime_error("failed to open file: " + filepath);
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			throw std::runtime_error("failed to get size of file: " + filepath);
+		}
+		fileSize = static_cast<size_t>(size.QuadPart);
+		// can't map an empty file, but there's nothing to map anyway
+		if (fileSize == 0)
+		{
+			return;
+		}
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+		{
+			view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		if (view == nullptr)
+		{
+			if (mapping != nullptr)
+			{
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			throw std::runtime_error("failed to map file: " + filepath);
+		}
+	}
+
+	TvMappedFile::~TvMappedFile()
+	{
+		if (view != nullptr)
+		{
+			UnmapViewOfFile(view);
+		}
+		if (mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
+		if (file != nullptr)
+		{
+			CloseHandle(file);
+		}
+	}
+#else
+	TvMappedFile::TvMappedFile(const std::string& filepath) : filepath{ filepath }
+	{
+		int fd = open(filepath.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			throw std::runtime_error("failed to open file: " + filepath);
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			close(fd);
+			throw std::runtime_error("failed to get size of file: " + filepath);
+		}
+		fileSize = static_cast<size_t>(info.st_size);
+		if (fileSize > 0)
+		{
+			void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped == MAP_FAILED)
+			{
+				close(fd);
+				throw std::runtime_error("failed to map file: " + filepath);
+			}
+			view = mapped;
+		}
+		// the mapping keeps its own reference to the file
+		close(fd);
+	}
+
+	TvMappedFile::~TvMappedFile()
+	{
+		if (view != nullptr)
+		{
+			munmap(const_cast<void*>(view), fileSize);
+		}
+	}
+#endif
+}
\ No newline at end of file
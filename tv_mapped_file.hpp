@@ -0,0 +1,34 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <string>
+
+namespace tv
+{
+	// A read only file mapped straight into memory, no reading into a buffer first
+	// The mapping starts on a page boundary, so the data is aligned for anything (SPIR-V needs 4 bytes).
+	class TvMappedFile
+	{
+	public:
+		// throws if the file can't be opened or mapped, an empty file maps to data() == nullptr
+		explicit TvMappedFile(const std::string& filepath);
+		~TvMappedFile();
+
+		TvMappedFile(const TvMappedFile&) = delete;
+		void operator=(const TvMappedFile&) = delete;
+
+		const void* data() const { return view; }
+		size_t size() const { return fileSize; }
+		const std::string& path() const { return filepath; }
+	private:
+		std::string filepath;
+		const void* view = nullptr;
+		size_t fileSize = 0;
+#ifdef _WIN32
+		// HANDLEs, kept as void* so windows.h stays out of the header
+		void* file = nullptr;
+		void* mapping = nullptr;
+#endif
+	};
+}
\ No newline at end of file
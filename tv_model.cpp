@@ -0,0 +1,251 @@
+#include "tv_model.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace tv
+{
+	TvModel::TvModel(TvDevice& device, TvUploadManager& uploads, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, VertexLayout layout)
+		: tvDevice{ device }, layout{ layout }
+	{
+		create(uploads, { Mesh{ vertices, indices } }, !indices.empty());
+	}
+
+	TvModel::TvModel(TvDevice& device, TvUploadManager& uploads, const std::vector<Mesh>& meshes, VertexLayout layout)
+		: tvDevice{ device }, layout{ layout }
+	{
+		create(uploads, meshes, meshes.size() > 1 || (meshes.size() == 1 && !meshes[0].indices.empty()));
+	}
+
+	TvModel::~TvModel()
+	{
+		tvDevice.destroyBuffer(vertexBuffer, vertexAllocation);
+		if (indexBuffer != VK_NULL_HANDLE)
+		{
+			tvDevice.destroyBuffer(indexBuffer, indexAllocation);
+		}
+	}
+
+	void TvModel::create(TvUploadManager& uploads, const std::vector<Mesh>& meshData, bool indexed)
+	{
+		if (layout != VertexLayout::Interleaved && layout != VertexLayout::Split)
+		{
+			throw std::runtime_error(std::string("a model can't have a ") + layoutName(layout) + " vertex layout");
+		}
+		if (meshData.empty())
+		{
+			throw std::runtime_error("a model needs at least one mesh");
+		}
+
+		// every mesh goes after the one before it, its indices stay relative to its own first vertex
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		uint32_t maxMeshVertexCount = 0;
+		for (const Mesh& mesh : meshData)
+		{
+			if (mesh.vertices.size() < 3)
+			{
+				throw std::runtime_error("a mesh needs at least 3 vertices");
+			}
+			MeshRange range;
+			range.vertexOffset = static_cast<int32_t>(vertices.size());
+			range.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+			vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+			maxMeshVertexCount = std::max(maxMeshVertexCount, range.vertexCount);
+
+			// centered on the box around the positions, not the tightest sphere but close enough for culling
+			glm::vec3 low = mesh.vertices[0].position;
+			glm::vec3 high = low;
+			for (const Vertex& vertex : mesh.vertices)
+			{
+				low = glm::min(low, vertex.position);
+				high = glm::max(high, vertex.position);
+			}
+			const glm::vec3 center = (low + high) * 0.5f;
+			float radius = 0.0f;
+			for (const Vertex& vertex : mesh.vertices)
+			{
+				radius = std::max(radius, glm::length(vertex.position - center));
+			}
+			range.bounds = glm::vec4{ center, radius };
+
+			if (indexed)
+			{
+				range.firstIndex = static_cast<uint32_t>(indices.size());
+				if (mesh.indices.empty())
+				{
+					for (uint32_t i = 0; i < range.vertexCount; i++)
+					{
+						indices.push_back(i);
+					}
+				}
+				else
+				{
+					// the next mesh's vertices come straight after this one's, so a bad index would quietly draw those
+					// (and keeping every index under the mesh's vertex count is what makes 16 bit indices safe)
+					for (uint32_t index : mesh.indices)
+					{
+						if (index >= range.vertexCount)
+						{
+							throw std::runtime_error("a mesh index is past the end of its vertices");
+						}
+					}
+					indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+				}
+				range.indexCount = static_cast<uint32_t>(indices.size()) - range.firstIndex;
+			}
+			meshes.push_back(range);
+		}
+
+		createVertexBuffer(uploads, vertices);
+		createIndexBuffer(uploads, indices, maxMeshVertexCount);
+	}
+
+	void TvModel::createVertexBuffer(TvUploadManager& uploads, const std::vector<Vertex>& vertices)
+	{
+		vertexCount = static_cast<uint32_t>(vertices.size());
+		vertexBufferSize = sizeof(Vertex) * vertexCount;
+		tvDevice.createBuffer(
+			vertexBufferSize,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			vertexBuffer,
+			vertexAllocation);
+
+		if (layout == VertexLayout::Interleaved)
+		{
+			streamCount = 1;
+			uploads.uploadBuffer(vertexBuffer, 0, vertices.data(), vertexBufferSize);
+			return;
+		}
+
+		// split: every position first, then every color, in the same buffer
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> colors;
+		positions.reserve(vertexCount);
+		colors.reserve(vertexCount);
+		for (const Vertex& vertex : vertices)
+		{
+			positions.push_back(vertex.position);
+			colors.push_back(vertex.color);
+		}
+		streamCount = 2;
+		streamOffsets[1] = sizeof(glm::vec3) * vertexCount;
+		uploads.uploadBuffer(vertexBuffer, streamOffsets[0], positions.data(), sizeof(glm::vec3) * vertexCount);
+		uploads.uploadBuffer(vertexBuffer, streamOffsets[1], colors.data(), sizeof(glm::vec3) * vertexCount);
+	}
+
+	void TvModel::createIndexBuffer(TvUploadManager& uploads, const std::vector<uint32_t>& indices, uint32_t maxMeshVertexCount)
+	{
+		indexCount = static_cast<uint32_t>(indices.size());
+		if (indexCount == 0)
+		{
+			return;
+		}
+
+		std::vector<uint16_t> shortIndices;
+		const void* data = indices.data();
+		VkDeviceSize indexSize = sizeof(uint32_t);
+		if (maxMeshVertexCount <= std::numeric_limits<uint16_t>::max() + 1u)
+		{
+			shortIndices.assign(indices.begin(), indices.end());
+			data = shortIndices.data();
+			indexSize = sizeof(uint16_t);
+			indexType = VK_INDEX_TYPE_UINT16;
+		}
+
+		indexBufferSize = indexSize * indexCount;
+		tvDevice.createBuffer(
+			indexBufferSize,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indexBuffer,
+			indexAllocation);
+		uploads.uploadBuffer(indexBuffer, 0, data, indexBufferSize);
+	}
+
+	void TvModel::bind(VkCommandBuffer commandBuffer)
+	{
+		VkBuffer buffers[] = { vertexBuffer, vertexBuffer };
+		vkCmdBindVertexBuffers(commandBuffer, 0, streamCount, buffers, streamOffsets);
+		if (indexBuffer != VK_NULL_HANDLE)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+		}
+	}
+
+	void TvModel::drawMesh(VkCommandBuffer commandBuffer, uint32_t mesh, uint32_t instanceCount, uint32_t firstInstance)
+	{
+		assert(mesh < meshes.size() && "mesh out of range");
+		const MeshRange& range = meshes[mesh];
+		if (indexBuffer != VK_NULL_HANDLE)
+		{
+			vkCmdDrawIndexed(commandBuffer, range.indexCount, instanceCount, range.firstIndex, range.vertexOffset, firstInstance);
+		}
+		else
+		{
+			vkCmdDraw(commandBuffer, range.vertexCount, instanceCount, static_cast<uint32_t>(range.vertexOffset), firstInstance);
+		}
+	}
+
+	VkDrawIndexedIndirectCommand TvModel::indirectCommand(uint32_t mesh, uint32_t instanceCount, uint32_t firstInstance) const
+	{
+		assert(indexBuffer != VK_NULL_HANDLE && "indirect commands are indexed, the model has to be too");
+		const MeshRange& range = meshes.at(mesh);
+		VkDrawIndexedIndirectCommand command{};
+		command.indexCount = range.indexCount;
+		command.instanceCount = instanceCount;
+		command.firstIndex = range.firstIndex;
+		command.vertexOffset = range.vertexOffset;
+		command.firstInstance = firstInstance;
+		return command;
+	}
+
+	void TvModel::vertexInputDescriptions(VertexLayout layout, std::vector<VkVertexInputBindingDescription>& bindings,
+		std::vector<VkVertexInputAttributeDescription>& attributes)
+	{
+		// location 0 is always the position, 1 the color
+		bindings.clear();
+		attributes.clear();
+		switch (layout)
+		{
+		case VertexLayout::None:
+			break;
+		case VertexLayout::Interleaved:
+			bindings.push_back({ 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX });
+			attributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position) });
+			attributes.push_back({ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) });
+			break;
+		case VertexLayout::Split:
+			bindings.push_back({ 0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX });
+			bindings.push_back({ 1, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX });
+			attributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 });
+			attributes.push_back({ 1, 1, VK_FORMAT_R32G32B32_SFLOAT, 0 });
+			break;
+		case VertexLayout::PositionOnly:
+			bindings.push_back({ 0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX });
+			attributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 });
+			break;
+		default:
+			assert(false && "unknown vertex layout");
+			break;
+		}
+	}
+
+	const char* TvModel::layoutName(VertexLayout layout)
+	{
+		switch (layout)
+		{
+		case VertexLayout::None: return "none";
+		case VertexLayout::Interleaved: return "interleaved";
+		case VertexLayout::Split: return "split";
+		case VertexLayout::PositionOnly: return "position only";
+		default: return "unknown";
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+#include "tv_device.hpp"
+#include "tv_upload_manager.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace tv
+{
+	// How a model's vertices are laid out in its vertex buffer, and what a pipeline expects to read
+	enum class VertexLayout : uint8_t
+	{
+		// no vertex buffers at all, the shader makes up its own vertices
+		None,
+		// one stream with whole vertices
+		Interleaved,
+		// positions in one stream and everything else in another, so passes that only need positions (depth prepass,
+		// shadows) don't drag the rest through the cache
+		Split,
+		// for pipelines that only read the position stream of a Split model
+		PositionOnly,
+	};
+
+	// Geometry that lives in device local vertex/index buffers
+	// A model can hold several meshes merged into the same buffers (each one indexed from 0, placed with vertexOffset),
+	// so one bind covers all of them and they can be drawn together from an indirect buffer.
+	// The data goes up through the upload manager, so it's only usable once the token of the flush after creating the
+	// model has completed. Don't destroy one while the gpu is still drawing it (defer it on the frame timeline).
+	class TvModel
+	{
+	public:
+		struct Vertex
+		{
+			glm::vec3 position;
+			glm::vec3 color;
+		};
+
+		struct Mesh
+		{
+			std::vector<Vertex> vertices;
+			// empty draws the vertices in order
+			std::vector<uint32_t> indices;
+		};
+
+		// where a mesh ended up in the merged buffers
+		struct MeshRange
+		{
+			uint32_t firstIndex = 0;
+			uint32_t indexCount = 0;
+			int32_t vertexOffset = 0;
+			uint32_t vertexCount = 0;
+			// bounding sphere around the mesh's positions, center in xyz and radius in w
+			glm::vec4 bounds{ 0.0f };
+		};
+
+		// layout can't be PositionOnly (that's for pipelines), indices can be empty to draw the vertices in order
+		TvModel(TvDevice& device, TvUploadManager& uploads, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices = {}, VertexLayout layout = VertexLayout::Interleaved);
+		// several meshes in one set of buffers, a model with more than one is always indexed (meshes without indices get
+		// 0, 1, 2...) so every mesh can be drawn with an indexed indirect command
+		TvModel(TvDevice& device, TvUploadManager& uploads, const std::vector<Mesh>& meshes, VertexLayout layout = VertexLayout::Interleaved);
+		~TvModel();
+
+		TvModel(const TvModel&) = delete;
+		void operator=(const TvModel&) = delete;
+
+		// binds every vertex stream (and the index buffer), before draw
+		void bind(VkCommandBuffer commandBuffer);
+		// draws the first mesh (the only one in most models)
+		void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0) { drawMesh(commandBuffer, 0, instanceCount, firstInstance); }
+		void drawMesh(VkCommandBuffer commandBuffer, uint32_t mesh, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+		// the same draw as drawMesh, for an indirect buffer (only for indexed models)
+		VkDrawIndexedIndirectCommand indirectCommand(uint32_t mesh, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const;
+
+		VertexLayout vertexLayout() const { return layout; }
+		bool isIndexed() const { return indexBuffer != VK_NULL_HANDLE; }
+		uint32_t meshCount() const { return static_cast<uint32_t>(meshes.size()); }
+		const MeshRange& mesh(uint32_t mesh) const { return meshes.at(mesh); }
+		// totals over every mesh
+		uint32_t getVertexCount() const { return vertexCount; }
+		uint32_t getIndexCount() const { return indexCount; }
+		// vertex + index buffer bytes
+		VkDeviceSize memorySize() const { return vertexBufferSize + indexBufferSize; }
+
+		// the vertex input state for a pipeline reading this layout, goes in PipelineConfigInfo
+		static void vertexInputDescriptions(VertexLayout layout, std::vector<VkVertexInputBindingDescription>& bindings,
+			std::vector<VkVertexInputAttributeDescription>& attributes);
+		static const char* layoutName(VertexLayout layout);
+	private:
+		// merges the meshes and uploads them, indexed is false only for a single mesh without indices
+		void create(TvUploadManager& uploads, const std::vector<Mesh>& meshData, bool indexed);
+		void createVertexBuffer(TvUploadManager& uploads, const std::vector<Vertex>& vertices);
+		// 16 bit when every mesh fits, the indices are per mesh so it's the biggest mesh that counts
+		void createIndexBuffer(TvUploadManager& uploads, const std::vector<uint32_t>& indices, uint32_t maxMeshVertexCount);
+
+		TvDevice& tvDevice;
+		VertexLayout layout;
+		std::vector<MeshRange> meshes;
+
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		TvAllocation vertexAllocation;
+		VkDeviceSize vertexBufferSize = 0;
+		uint32_t vertexCount = 0;
+		// where each stream starts in vertexBuffer (only the first is used when interleaved)
+		VkDeviceSize streamOffsets[2] = { 0, 0 };
+		uint32_t streamCount = 0;
+
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		TvAllocation indexAllocation;
+		VkDeviceSize indexBufferSize = 0;
+		uint32_t indexCount = 0;
+		// 16 bit whenever every vertex can be reached with one, half the index bandwidth
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	};
+}
\ No newline at end of file
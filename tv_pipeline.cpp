@@ -1,95 +1,132 @@
 #include "tv_pipeline.hpp"
 
 // std
-#include <fstream>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
+#include <algorithm>
+#include <tuple>
 
 namespace tv
 {
-	TvPipeline::TvPipeline(TvDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo info) : tvDevice{device}
+	TvPipeline::TvPipeline(TvDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo info, VkPipelineCache pipelineCache) : tvDevice{device}
 	{
 		// call our private constructor once again
-		createGraphicsPipeline(vertFilepath, fragFilepath, info);
+		createGraphicsPipeline(vertFilepath, fragFilepath, info, pipelineCache);
 	}
 
-	TvPipeline::~TvPipeline()
+	TvPipeline::TvPipeline(TvDevice& device, VkGraphicsPipelineLibraryFlagsEXT libraryParts, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo info, VkPipelineCache pipelineCache)
+		: tvDevice{ device }, parts{ libraryParts }
 	{
-		// make sure to destroy all the vulkan stuff when we destroy the pipeline
-		vkDestroyShaderModule(tvDevice.device(), vertShaderModule, nullptr);
-		vkDestroyShaderModule(tvDevice.device(), fragShaderModule, nullptr);
-		vkDestroyPipeline(tvDevice.device(), graphicsPipeline, nullptr);
+		assert(libraryParts != 0 && "Cannot create pipeline library: no parts asked for");
+		createGraphicsPipeline(vertFilepath, fragFilepath, info, pipelineCache);
 	}
 
-	std::vector<char> TvPipeline::readFile(const std::string& filepath)
+	TvPipeline::TvPipeline(TvDevice& device, std::vector<std::shared_ptr<TvPipeline>> librariesToLink, VkPipelineLayout pipelineLayout, bool extendedDynamicState, bool optimize, VkPipelineCache pipelineCache)
+		: tvDevice{ device }, extendedDynamicState{ extendedDynamicState }, libraries{ std::move(librariesToLink) }, optimized{ optimize }
 	{
-		// Standard file programming stuff with added c++ fanciness
-		// std::ios::ate moves to the end of the file, essentially handing us the filesize for later
-		// very useful
-		std::ifstream file{ filepath, std::ios::ate | std::ios::binary };
-		if (!file.is_open())
+		std::vector<VkPipeline> handles;
+		VkGraphicsPipelineLibraryFlagsEXT linkedParts = 0;
+		for (const auto& library : libraries)
 		{
-			// well shit can't open the file (you, yes you trent, fucked up somehow)
-			throw std::runtime_error("failed to open file: " + filepath);
+			assert(library->parts != 0 && "Cannot link graphics pipeline: only libraries can be linked");
+			linkedParts |= library->parts;
+			handles.push_back(library->graphicsPipeline);
 		}
+		assert(linkedParts == (VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT |
+			VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT) &&
+			"Cannot link graphics pipeline: the libraries don't cover every part");
+
+		VkPipelineLibraryCreateInfoKHR linkInfo{};
+		linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+		linkInfo.libraryCount = static_cast<uint32_t>(handles.size());
+		linkInfo.pLibraries = handles.data();
 
-		// get the filesize by reading the pos, cuz we ate that hoe
-		size_t fileSize = static_cast<size_t>(file.tellg());
-		std::vector<char> buf(fileSize);
+		// everything else (shaders, state, dynamic state) comes from the libraries
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.pNext = &linkInfo;
+		pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-		// standard file stuff, back to the start and read everything before closing our file like a good boy
-		file.seekg(0);
-		file.read(buf.data(), fileSize);
-		file.close();
+		if (vkCreateGraphicsPipelines(tvDevice.device(), pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to link graphics pipeline");
+		}
+	}
 
-		return buf;
+	TvPipeline::~TvPipeline()
+	{
+		// make sure to destroy all the vulkan stuff when we destroy the pipeline
+		// (the shader modules belong to the registry)
+		vkDestroyPipeline(tvDevice.device(), graphicsPipeline, nullptr);
 	}
 
-	void TvPipeline::createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo configInfo)
+	void TvPipeline::createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath, PipelineConfigInfo configInfo, VkPipelineCache pipelineCache)
 	{
 		// here's where imma attempt to explain things i don't understand
 
+		// a library only has the shaders for the parts it's building (and the vertex input/fragment output parts don't
+		// care about the layout)
+		const bool hasVert = parts == 0 || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+		const bool hasFrag = parts == 0 || (parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+
 		// these asserts should obviously never be false unless you haven't finished the code or something fucked up
-		assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
-		assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: no renderPass provided in configInfo");
+		assert((!(hasVert || hasFrag) || configInfo.pipelineLayout != VK_NULL_HANDLE) && "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
+		assert((parts == VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT || configInfo.renderPass != VK_NULL_HANDLE) && "Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-		// read our compiled shaders as bytes
-		auto vertCode = readFile(vertFilepath);
-		auto fragCode = readFile(fragFilepath);
+		prepareConfigInfo(configInfo);
 
-		// create shader modules from bytes, attach it to the class
-		createShaderModule(vertCode, &vertShaderModule);
-		createShaderModule(fragCode, &fragShaderModule);
+		// grab the shader modules from the device's registry, they only have to live until the pipeline is created
+		// so these go away at the end of this function (and the registry can drop them once nobody else needs them)
+		std::shared_ptr<TvShaderModule> vertShaderModule = hasVert ? tvDevice.shaderModules().load(vertFilepath) : nullptr;
+		std::shared_ptr<TvShaderModule> fragShaderModule = hasFrag ? tvDevice.shaderModules().load(fragFilepath) : nullptr;
+
+		// specialization constants, the infos point into these so they live until the pipeline is created
+		std::vector<VkSpecializationMapEntry> vertEntries, fragEntries;
+		std::vector<uint8_t> vertData, fragData;
+		VkSpecializationInfo vertSpecialization = configInfo.vertSpecialization.build(vertEntries, vertData);
+		VkSpecializationInfo fragSpecialization = configInfo.fragSpecialization.build(fragEntries, fragData);
 
 		// create the stage info for the vert and frag stage
 		VkPipelineShaderStageCreateInfo shaderStages[2];
+		uint32_t stageCount = 0;
 
 		// vert
-		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		shaderStages[0].module = vertShaderModule;
-		shaderStages[0].pName = "main";		// entry point for the program
-		shaderStages[0].flags = 0;
-		shaderStages[0].pNext = nullptr;
-		shaderStages[0].pSpecializationInfo = nullptr;
+		if (hasVert)
+		{
+			VkPipelineShaderStageCreateInfo& stage = shaderStages[stageCount++];
+			stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+			stage.module = vertShaderModule->handle();
+			stage.pName = "main";		// entry point for the program
+			stage.flags = 0;
+			stage.pNext = nullptr;
+			stage.pSpecializationInfo = configInfo.vertSpecialization.empty() ? nullptr : &vertSpecialization;
+		}
 
 		// frag
-		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		shaderStages[1].module = fragShaderModule;
-		shaderStages[1].pName = "main";		// entry point for the program
-		shaderStages[1].flags = 0;
-		shaderStages[1].pNext = nullptr;
-		shaderStages[1].pSpecializationInfo = nullptr;
+		if (hasFrag)
+		{
+			VkPipelineShaderStageCreateInfo& stage = shaderStages[stageCount++];
+			stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			stage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+			stage.module = fragShaderModule->handle();
+			stage.pName = "main";		// entry point for the program
+			stage.flags = 0;
+			stage.pNext = nullptr;
+			stage.pSpecializationInfo = configInfo.fragSpecialization.empty() ? nullptr : &fragSpecialization;
+		}
 
 		// some extra input info for the vertex stage (idk why the frag doesn't also have one)
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexAttributeDescriptionCount = 0;		// Should change once we arent hardcoding verts
-		vertexInputInfo.vertexBindingDescriptionCount = 0;
-		vertexInputInfo.pVertexAttributeDescriptions = nullptr;
-		vertexInputInfo.pVertexBindingDescriptions = nullptr;
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(configInfo.attributeDescriptions.size());
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(configInfo.bindingDescriptions.size());
+		vertexInputInfo.pVertexAttributeDescriptions = configInfo.attributeDescriptions.data();
+		vertexInputInfo.pVertexBindingDescriptions = configInfo.bindingDescriptions.data();
 
 		
 
@@ -98,9 +135,20 @@ namespace tv
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 
 		// bind the stage info
-		pipelineInfo.stageCount = 2;
+		pipelineInfo.stageCount = stageCount;
 		pipelineInfo.pStages = shaderStages;
 
+		// a library ignores whatever state isn't part of it, so the rest can be filled in like normal
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+		if (parts != 0)
+		{
+			libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+			libraryInfo.flags = parts;
+			pipelineInfo.pNext = &libraryInfo;
+			// keep what an optimized link needs, not just a fast one
+			pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+		}
+
 		// bind the config info
 		pipelineInfo.pVertexInputState = &vertexInputInfo;
 		pipelineInfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
@@ -109,7 +157,7 @@ namespace tv
 		pipelineInfo.pMultisampleState = &configInfo.multisampleInfo;
 		pipelineInfo.pColorBlendState = &configInfo.colorBlendInfo;
 		pipelineInfo.pDepthStencilState = &configInfo.depthStencilInfo;
-		pipelineInfo.pDynamicState = nullptr;
+		pipelineInfo.pDynamicState = &configInfo.dynamicStateInfo;
 		pipelineInfo.layout = configInfo.pipelineLayout;
 		pipelineInfo.renderPass = configInfo.renderPass;
 		pipelineInfo.subpass = configInfo.subpass;
@@ -118,26 +166,88 @@ namespace tv
 		pipelineInfo.basePipelineIndex = -1;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(tvDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+		if (vkCreateGraphicsPipelines(tvDevice.device(), pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
 		{
 			// Something went wrong, probably my fault but not as stupid of a mistake
 			throw std::runtime_error("failed to create graphics pipeline");
 		}
 	}
 
-	void TvPipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* module)
+	void TvPipeline::prepareConfigInfo(PipelineConfigInfo& configInfo)
 	{
-		// creating shader module from byte array is surprisingly easy (it's already compiled ig)
-		VkShaderModuleCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = code.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		// the extended states go on the end of whatever dynamic state the config already asked for
+		extendedDynamicState = configInfo.extendedDynamicState;
+		if (extendedDynamicState)
+		{
+			assert(tvDevice.supportsExtendedDynamicState() && "Cannot create graphics pipeline: extended dynamic state isn't supported");
+			configInfo.dynamicStateEnables.insert(configInfo.dynamicStateEnables.end(), {
+				VK_DYNAMIC_STATE_CULL_MODE_EXT,
+				VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+				VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT,
+				VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+				VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+				VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT });
+		}
 
-		if (vkCreateShaderModule(tvDevice.device(), &createInfo, nullptr, module) != VK_SUCCESS)
+		// configInfo is a copy, so the pointers inside it still point into the one it was copied from
+		// (which might be gone by now if we're compiling on another thread), point them at our own copy
+		configInfo.colorBlendInfo.pAttachments = &configInfo.colorBlendAttachment;
+		configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
+		configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
+	}
+
+	void SpecializationConstants::insert(const Constant& constant)
+	{
+		auto it = std::lower_bound(constants.begin(), constants.end(), constant.id,
+			[](const Constant& existing, uint32_t id) { return existing.id < id; });
+		if (it != constants.end() && it->id == constant.id)
+		{
+			*it = constant;
+		}
+		else
+		{
+			constants.insert(it, constant);
+		}
+	}
+
+	VkSpecializationInfo SpecializationConstants::build(std::vector<VkSpecializationMapEntry>& entries, std::vector<uint8_t>& data) const
+	{
+		entries.clear();
+		data.clear();
+		for (const Constant& constant : constants)
 		{
-			// i'm not entirely sure how this would fail actually
-			throw std::runtime_error("failed to create shader module");
+			VkSpecializationMapEntry entry{};
+			entry.constantID = constant.id;
+			entry.offset = static_cast<uint32_t>(data.size());
+			entry.size = constant.size;
+			entries.push_back(entry);
+			data.insert(data.end(), constant.bytes, constant.bytes + constant.size);
 		}
+
+		VkSpecializationInfo info{};
+		info.mapEntryCount = static_cast<uint32_t>(entries.size());
+		info.pMapEntries = entries.data();
+		info.dataSize = data.size();
+		info.pData = data.data();
+		return info;
+	}
+
+	bool SpecializationConstants::operator==(const SpecializationConstants& other) const
+	{
+		return !(*this < other) && !(other < *this);
+	}
+
+	bool SpecializationConstants::operator<(const SpecializationConstants& other) const
+	{
+		return std::lexicographical_compare(constants.begin(), constants.end(), other.constants.begin(), other.constants.end(),
+			[](const Constant& a, const Constant& b)
+			{
+				if (a.id != b.id || a.size != b.size)
+				{
+					return std::tie(a.id, a.size) < std::tie(b.id, b.size);
+				}
+				return std::memcmp(a.bytes, b.bytes, a.size) < 0;
+			});
 	}
 
 	void TvPipeline::Bind(VkCommandBuffer commandBuffer)
@@ -146,7 +256,36 @@ namespace tv
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 	}
 
-	void TvPipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo, uint32_t width, uint32_t height)
+	void TvPipeline::setViewport(VkCommandBuffer commandBuffer, VkExtent2D extent)
+	{
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = static_cast<float>(extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor{ { 0, 0 }, extent };
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+
+	void TvPipeline::setRenderState(VkCommandBuffer commandBuffer, const DynamicRenderState& state)
+	{
+		if (!extendedDynamicState)
+		{
+			return;
+		}
+		const ExtendedDynamicStateFunctions& functions = tvDevice.extendedDynamicState();
+		functions.cmdSetCullMode(commandBuffer, state.cullMode);
+		functions.cmdSetFrontFace(commandBuffer, state.frontFace);
+		functions.cmdSetPrimitiveTopology(commandBuffer, state.topology);
+		functions.cmdSetDepthTestEnable(commandBuffer, state.depthTest ? VK_TRUE : VK_FALSE);
+		functions.cmdSetDepthWriteEnable(commandBuffer, state.depthWrite ? VK_TRUE : VK_FALSE);
+		functions.cmdSetDepthCompareOp(commandBuffer, state.depthCompareOp);
+	}
+
+	void TvPipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo)
 	{
 		// here's the big one: the default config which will probably become the permanent config for a while
 		//PipelineConfigInfo configInfo{};
@@ -156,24 +295,13 @@ namespace tv
 		configInfo.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;	// Every three verts is a triangle
 		configInfo.inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-		// The viewport data, like the origin, w/h, depth clipping stuff (this might actually be fucked?)
-		configInfo.viewport.x = 0.0f;
-		configInfo.viewport.y = 0.0f;
-		configInfo.viewport.width = static_cast<float>(width);
-		configInfo.viewport.height = static_cast<float>(height);
-		configInfo.viewport.minDepth = 0.0f;
-		configInfo.viewport.maxDepth = 1.0f;
-
-		// scissors used to clip the screen (not helpful rn)
-		configInfo.scissor.offset = { 0, 0 };
-		configInfo.scissor.extent = { width, height };
-
-		// viewport info contains viewport
+		// viewport info only says how many there are, the viewport and scissor themselves are set while recording
+		// (see setViewport) so the window size isn't baked into the pipeline
 		configInfo.viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		configInfo.viewportInfo.viewportCount = 1; // possible vr things here?
-		configInfo.viewportInfo.pViewports = &configInfo.viewport;
+		configInfo.viewportInfo.pViewports = nullptr;
 		configInfo.viewportInfo.scissorCount = 1;
-		configInfo.viewportInfo.pScissors = &configInfo.scissor;
+		configInfo.viewportInfo.pScissors = nullptr;
 
 		// info for the rasterization stage, pretty straightforward
 		configInfo.rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -231,5 +359,17 @@ namespace tv
 		configInfo.depthStencilInfo.stencilTestEnable = VK_FALSE;
 		configInfo.depthStencilInfo.front = {};		// opt
 		configInfo.depthStencilInfo.back = {};		// opt
+
+		// the bits that get set while recording instead
+		configInfo.dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		configInfo.dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
+		configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
+		configInfo.dynamicStateInfo.flags = 0;
+		configInfo.extendedDynamicState = false;
+
+		// no vertex buffers unless someone says otherwise
+		configInfo.bindingDescriptions.clear();
+		configInfo.attributeDescriptions.clear();
 	}
 }
\ No newline at end of file
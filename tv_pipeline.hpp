@@ -2,11 +2,63 @@
 #include "tv_device.hpp"
 
 // std
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace tv
 {
+	// Values for a shader stage's specialization constants (layout(constant_id = N) const ...), baked in when the
+	// pipeline compiles so the driver can fold them like any other constant. One SPIR-V module, as many variants as you like.
+	// Ids the shader doesn't declare are ignored by vulkan.
+	class SpecializationConstants
+	{
+	public:
+		// bool, 32 bit ints/floats, and 64 bit ones (those need the shader to enable int64/float64)
+		template <typename T>
+		SpecializationConstants& set(uint32_t constantId, T value)
+		{
+			static_assert(std::is_arithmetic<T>::value && (sizeof(T) == 4 || sizeof(T) == 8 || std::is_same<T, bool>::value),
+				"specialization constants are bool or 32/64 bit ints and floats");
+			Constant constant{ constantId, 0, {} };
+			if constexpr (std::is_same<T, bool>::value)
+			{
+				// glsl bools are VkBool32
+				VkBool32 boolValue = value ? VK_TRUE : VK_FALSE;
+				constant.size = sizeof(boolValue);
+				std::memcpy(constant.bytes, &boolValue, sizeof(boolValue));
+			}
+			else
+			{
+				constant.size = sizeof(T);
+				std::memcpy(constant.bytes, &value, sizeof(T));
+			}
+			insert(constant);
+			return *this;
+		}
+
+		bool empty() const { return constants.empty(); }
+		// fills entries and data (which the info points into, so keep them around until the pipeline is created)
+		VkSpecializationInfo build(std::vector<VkSpecializationMapEntry>& entries, std::vector<uint8_t>& data) const;
+
+		bool operator==(const SpecializationConstants& other) const;
+		bool operator<(const SpecializationConstants& other) const;
+	private:
+		struct Constant
+		{
+			uint32_t id;
+			uint32_t size;
+			uint8_t bytes[8];
+		};
+		// keeps them sorted by id, so the same values set in any order compare equal
+		void insert(const Constant& constant);
+
+		std::vector<Constant> constants;
+	};
+
 	// Stores all data on the graphics pipeline layout and settings
 	struct PipelineConfigInfo 
 	{
@@ -16,8 +68,10 @@ namespace tv
 		PipelineConfigInfo(const PipelineConfigInfo&) = delete;
 		PipelineConfigInfo & operator=(const PipelineConfigInfo&) = delete;*/
 
-		VkViewport viewport;
-		VkRect2D scissor;
+		// what the vertex buffers look like (see TvModel::vertexInputDescriptions), empty means there aren't any
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+		// viewport and scissor are always dynamic, set them with TvPipeline::setViewport after binding
 		VkPipelineViewportStateCreateInfo viewportInfo;
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
 		VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -25,14 +79,43 @@ namespace tv
 		VkPipelineColorBlendAttachmentState colorBlendAttachment;
 		VkPipelineColorBlendStateCreateInfo colorBlendInfo;
 		VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
+		std::vector<VkDynamicState> dynamicStateEnables;
+		VkPipelineDynamicStateCreateInfo dynamicStateInfo;
+		// also make cull mode, front face, topology and depth test/write/compare dynamic (needs TvDevice::supportsExtendedDynamicState)
+		// the values above are ignored for those then, set them with TvPipeline::setRenderState instead
+		bool extendedDynamicState = false;
 		VkPipelineLayout pipelineLayout = nullptr;
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
+		// empty means the shader's own defaults
+		SpecializationConstants vertSpecialization;
+		SpecializationConstants fragSpecialization;
+	};
+	// the state extended dynamic state pipelines take while recording, defaults match defaultPipelineConfigInfo
+	struct DynamicRenderState
+	{
+		VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+		VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+		// without VK_EXT_extended_dynamic_state3 this can only switch within the same class (triangles, lines or points)
+		// as the pipeline's inputAssemblyInfo.topology
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		bool depthTest = true;
+		bool depthWrite = true;
+		VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
 	};
+
 	class TvPipeline
 	{
 	public:
-		TvPipeline(TvDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo info);
+		// pipelineCache lets the driver skip compiling anything it has seen before (see TvPipelineCache)
+		TvPipeline(TvDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo info, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+		// builds only some parts of a pipeline as a library to link later (VK_EXT_graphics_pipeline_library, see TvPipelineLibrary)
+		// a shader the parts don't include is never loaded, so its path can be empty
+		TvPipeline(TvDevice& device, VkGraphicsPipelineLibraryFlagsEXT libraryParts, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo info, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+		// links libraries that cover all four parts into a pipeline and keeps them alive for as long as it's around.
+		// without optimize the link is quick but the pipeline can run a bit slower than a monolithic one, with it the
+		// link takes about as long as a normal compile
+		TvPipeline(TvDevice& device, std::vector<std::shared_ptr<TvPipeline>> libraries, VkPipelineLayout pipelineLayout, bool extendedDynamicState, bool optimize, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
 		~TvPipeline();
 
 		// Remove those pesky copy operators
@@ -40,20 +123,29 @@ namespace tv
 		void operator=(const TvPipeline&) = delete;
 
 		void Bind(VkCommandBuffer commandBuffer);
-		static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo, uint32_t width, uint32_t height);
+		// covers the whole extent, call after Bind (nothing about the size is baked in, so resizes don't need a new pipeline)
+		void setViewport(VkCommandBuffer commandBuffer, VkExtent2D extent);
+		// does nothing unless the pipeline was made with extendedDynamicState, the config's values are baked in then
+		void setRenderState(VkCommandBuffer commandBuffer, const DynamicRenderState& state);
+		bool hasExtendedDynamicState() const { return extendedDynamicState; }
+		// 0 for a pipeline you can bind, otherwise the parts this library has
+		VkGraphicsPipelineLibraryFlagsEXT libraryParts() const { return parts; }
+		// linked from libraries without link time optimization
+		bool isFastLinked() const { return !libraries.empty() && !optimized; }
+		static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
 	private:
-		// reads a file as bytes (for reading compiled shader code)
-		static std::vector<char> readFile(const std::string& filepath);
-
-		void createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo info);
-		void createShaderModule(const std::vector<char>& code, VkShaderModule* module);
+		void createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath, PipelineConfigInfo info, VkPipelineCache pipelineCache);
+		// extended dynamic state adds its states, and the pointers get pointed at this copy
+		void prepareConfigInfo(PipelineConfigInfo& configInfo);
 
 		// our device class
 		TvDevice& tvDevice;
 		// vulcan pipeline class
 		VkPipeline graphicsPipeline;
-		// the compiled vert and frag shader modules
-		VkShaderModule vertShaderModule;
-		VkShaderModule fragShaderModule;
+		bool extendedDynamicState = false;
+		VkGraphicsPipelineLibraryFlagsEXT parts = 0;
+		// what a linked pipeline was linked from
+		std::vector<std::shared_ptr<TvPipeline>> libraries;
+		bool optimized = false;
 	};
 }
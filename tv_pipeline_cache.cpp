@@ -0,0 +1,185 @@
+#include "tv_pipeline_cache.hpp"
+#include "tv_hash.hpp"
+
+// std
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace tv
+{
+	TvPipelineCache::TvPipelineCache(TvDevice& device, std::string filepath) : tvDevice{ device }, filepath{ std::move(filepath) }
+	{
+		std::vector<char> initialData = loadValidData();
+		warm = !initialData.empty();
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = initialData.size();
+		cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+		if (vkCreatePipelineCache(tvDevice.device(), &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline cache");
+		}
+		std::cout << "pipeline cache: " << (warm ? "warm, loaded " + std::to_string(initialData.size()) + " bytes from " : "cold, nothing usable in ")
+			<< this->filepath << std::endl;
+	}
+
+	TvPipelineCache::~TvPipelineCache()
+	{
+		// never let a failed save take the app down on the way out
+		try
+		{
+			if (dirty)
+			{
+				save();
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "failed to save pipeline cache: " << e.what() << std::endl;
+		}
+		vkDestroyPipelineCache(tvDevice.device(), pipelineCache, nullptr);
+	}
+
+	TvPipelineCache::FileHeader TvPipelineCache::expectedHeader() const
+	{
+		FileHeader header{};
+		header.magic = FILE_MAGIC;
+		header.version = FILE_VERSION;
+		header.vendorID = tvDevice.properties.vendorID;
+		header.deviceID = tvDevice.properties.deviceID;
+		header.driverVersion = tvDevice.properties.driverVersion;
+		std::memcpy(header.pipelineCacheUUID, tvDevice.properties.pipelineCacheUUID, VK_UUID_SIZE);
+		return header;
+	}
+
+	std::vector<char> TvPipelineCache::loadValidData()
+	{
+		std::ifstream file{ filepath, std::ios::binary | std::ios::ate };
+		if (!file.is_open())
+		{
+			return {};
+		}
+		size_t fileSize = static_cast<size_t>(file.tellg());
+		if (fileSize < sizeof(FileHeader))
+		{
+			return {};
+		}
+		file.seekg(0);
+
+		FileHeader header;
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		FileHeader expected = expectedHeader();
+		if (header.magic != expected.magic || header.version != expected.version ||
+			header.vendorID != expected.vendorID || header.deviceID != expected.deviceID ||
+			header.driverVersion != expected.driverVersion ||
+			std::memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0 ||
+			header.dataSize != fileSize - sizeof(FileHeader))
+		{
+			return {};
+		}
+
+		std::vector<char> data(static_cast<size_t>(header.dataSize));
+		file.read(data.data(), data.size());
+		if (!file || fnv1a(data.data(), data.size()) != header.dataChecksum)
+		{
+			return {};
+		}
+
+		// the driver's own header should say the same thing, if it doesn't the driver would reject the data anyway
+		VkPipelineCacheHeaderVersionOne driverHeader;
+		if (data.size() < sizeof(driverHeader))
+		{
+			return {};
+		}
+		std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+		if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+			driverHeader.vendorID != expected.vendorID || driverHeader.deviceID != expected.deviceID ||
+			std::memcmp(driverHeader.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			return {};
+		}
+		return data;
+	}
+
+	void TvPipelineCache::saveIfDirty(std::chrono::seconds minInterval)
+	{
+		if (dirty && std::chrono::steady_clock::now() - lastSave >= minInterval)
+		{
+			// the cache is only a head start for the next run, not worth stopping this one over
+			try
+			{
+				save();
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "failed to save pipeline cache: " << e.what() << std::endl;
+				// still dirty, but a path that can't be written waits the full interval before the next try
+				lastSave = std::chrono::steady_clock::now();
+			}
+		}
+	}
+
+	void TvPipelineCache::save()
+	{
+		// cleared before grabbing the data, so a pipeline another thread adds meanwhile still gets saved next time
+		// (and set again if the save fails, so it gets retried)
+		dirty = false;
+		try
+		{
+			writeFile();
+		}
+		catch (...)
+		{
+			dirty = true;
+			throw;
+		}
+		lastSave = std::chrono::steady_clock::now();
+	}
+
+	void TvPipelineCache::writeFile()
+	{
+		size_t dataSize = 0;
+		if (vkGetPipelineCacheData(tvDevice.device(), pipelineCache, &dataSize, nullptr) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to get pipeline cache size");
+		}
+		std::vector<char> data(dataSize);
+		if (vkGetPipelineCacheData(tvDevice.device(), pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to get pipeline cache data");
+		}
+		data.resize(dataSize);
+
+		FileHeader header = expectedHeader();
+		header.dataSize = data.size();
+		header.dataChecksum = fnv1a(data.data(), data.size());
+
+		// write everything to the side first, only a complete file ever gets the real name
+		std::string tempPath = filepath + ".tmp";
+		{
+			std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(data.data(), data.size());
+			file.flush();
+			if (!file)
+			{
+				throw std::runtime_error("failed to write " + tempPath);
+			}
+		}
+
+#ifdef _WIN32
+		// rename won't replace an existing file on windows
+		std::remove(filepath.c_str());
+#endif
+		if (std::rename(tempPath.c_str(), filepath.c_str()) != 0)
+		{
+			throw std::runtime_error("failed to replace " + filepath);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include "tv_device.hpp"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace tv
+{
+	// VkPipelineCache that survives between runs
+	// The file is our own header (device, driver, size and checksum) followed by whatever vkGetPipelineCacheData gave us.
+	// Anything that doesn't match this exact device + driver gets thrown away and we start cold, a driver update
+	// invalidates the cache on its own. Saves go to a temp file that gets renamed over the old one, so a crash mid-save
+	// leaves the previous cache (or none) instead of a half written one.
+	class TvPipelineCache
+	{
+	public:
+		TvPipelineCache(TvDevice& device, std::string filepath = "pipeline_cache.bin");
+		// saves one last time
+		~TvPipelineCache();
+
+		TvPipelineCache(const TvPipelineCache&) = delete;
+		void operator=(const TvPipelineCache&) = delete;
+
+		VkPipelineCache cache() const { return pipelineCache; }
+		// true if we started with a valid cache from disk
+		bool isWarm() const { return warm; }
+
+		// call after creating pipelines, so the next save knows there's something new (any thread)
+		void markDirty() { dirty = true; }
+		// writes the cache out if something was added and it's been a while since the last save
+		// a failed save is logged rather than thrown, and tried again after another interval
+		void saveIfDirty(std::chrono::seconds minInterval = std::chrono::seconds{ 30 });
+		// throws if the file can't be written, the cache stays dirty
+		void save();
+	private:
+		// what gets written in front of the driver's data
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint32_t driverVersion;
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+			uint64_t dataSize;
+			uint64_t dataChecksum;
+		};
+		static constexpr uint32_t FILE_MAGIC = 0x43505654;	// "TVPC"
+		static constexpr uint32_t FILE_VERSION = 1;
+
+		// returns the cache data from the file if it's valid for this device, empty otherwise
+		std::vector<char> loadValidData();
+		// the header and the driver's data, to a temp file renamed over filepath
+		void writeFile();
+		FileHeader expectedHeader() const;
+
+		TvDevice& tvDevice;
+		std::string filepath;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		bool warm = false;
+		std::atomic<bool> dirty{ false };
+		std::chrono::steady_clock::time_point lastSave = std::chrono::steady_clock::now();
+	};
+}
\ No newline at end of file
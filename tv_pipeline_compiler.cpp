@@ -0,0 +1,154 @@
+#include "tv_pipeline_compiler.hpp"
+
+// std
+#include <chrono>
+
+namespace tv
+{
+	TvPipelineCompiler::TvPipelineCompiler(TvDevice& device, TvPipelineCache& pipelineCache, uint32_t threadCount)
+		: tvDevice{ device }, pipelineCache{ pipelineCache }
+	{
+		workers.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			workers.emplace_back(&TvPipelineCompiler::workerLoop, this);
+		}
+	}
+
+	TvPipelineCompiler::~TvPipelineCompiler()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+			jobs.clear();
+		}
+		jobReady.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	TvPipelineCompiler::Job TvPipelineCompiler::makeJob(PipelineBuild build)
+	{
+		return Job{ [this, build = std::move(build)]()
+		{
+			auto pipeline = build(pipelineCache.cache());
+			pipelineCache.markDirty();
+			return pipeline;
+		} };
+	}
+
+	PipelineFuture TvPipelineCompiler::compile(PipelineRequest request)
+	{
+		std::vector<PipelineRequest> requests;
+		requests.push_back(std::move(request));
+		return compile(std::move(requests)).front();
+	}
+
+	std::vector<PipelineFuture> TvPipelineCompiler::compile(std::vector<PipelineRequest> requests)
+	{
+		std::vector<PipelineBuild> builds;
+		builds.reserve(requests.size());
+		for (auto& request : requests)
+		{
+			builds.push_back([this, request = std::move(request)](VkPipelineCache cache)
+			{
+				return std::make_shared<TvPipeline>(tvDevice, request.vertFilepath, request.fragFilepath, request.config, cache);
+			});
+		}
+		return submit(std::move(builds));
+	}
+
+	PipelineFuture TvPipelineCompiler::submit(PipelineBuild build)
+	{
+		std::vector<PipelineBuild> builds;
+		builds.push_back(std::move(build));
+		return submit(std::move(builds)).front();
+	}
+
+	std::vector<PipelineFuture> TvPipelineCompiler::submit(std::vector<PipelineBuild> builds)
+	{
+		std::vector<Job> batch;
+		std::vector<PipelineFuture> futures;
+		batch.reserve(builds.size());
+		futures.reserve(builds.size());
+		for (auto& build : builds)
+		{
+			batch.push_back(makeJob(std::move(build)));
+			futures.push_back(batch.back().get_future().share());
+		}
+
+		// nobody to hand it to, do it now (and only let go of the shader modules once the whole batch is built)
+		if (workers.empty())
+		{
+			for (auto& job : batch)
+			{
+				job();
+			}
+			tvDevice.shaderModules().releaseUnused();
+			return futures;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			for (auto& job : batch)
+			{
+				jobs.push_back(std::move(job));
+			}
+		}
+		jobReady.notify_all();
+		return futures;
+	}
+
+	std::shared_ptr<TvPipeline> TvPipelineCompiler::ready(const PipelineFuture& future)
+	{
+		if (!future.valid() || future.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready)
+		{
+			return nullptr;
+		}
+		return future.get();
+	}
+
+	uint32_t TvPipelineCompiler::pendingCount()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		return static_cast<uint32_t>(jobs.size()) + running;
+	}
+
+	void TvPipelineCompiler::waitIdle()
+	{
+		std::unique_lock<std::mutex> lock{ mutex };
+		idle.wait(lock, [this]() { return jobs.empty() && running == 0; });
+	}
+
+	void TvPipelineCompiler::workerLoop()
+	{
+		std::unique_lock<std::mutex> lock{ mutex };
+		while (true)
+		{
+			jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			Job job = std::move(jobs.front());
+			jobs.pop_front();
+			running++;
+			lock.unlock();
+
+			// a failure ends up in the future, not here
+			job();
+
+			lock.lock();
+			running--;
+			if (jobs.empty() && running == 0)
+			{
+				// the batch is done, so the shader modules it used aren't needed anymore
+				// (anything a new job already grabbed is still referenced and stays)
+				tvDevice.shaderModules().releaseUnused();
+				idle.notify_all();
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+#include "tv_device.hpp"
+#include "tv_pipeline.hpp"
+#include "tv_pipeline_cache.hpp"
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tv
+{
+	// everything needed to build one pipeline (the layout and render pass have to stay alive until it's done)
+	struct PipelineRequest
+	{
+		std::string vertFilepath;
+		std::string fragFilepath;
+		PipelineConfigInfo config;
+	};
+
+	// a pipeline that might still be compiling
+	using PipelineFuture = std::shared_future<std::shared_ptr<TvPipeline>>;
+	// builds one pipeline some other way than from a PipelineRequest (linking libraries, say), with the shared cache
+	using PipelineBuild = std::function<std::shared_ptr<TvPipeline>(VkPipelineCache)>;
+
+	// Compiles pipelines in the background so the first frame doesn't have to wait for every one of them
+	// Requests go in a queue that a few threads of its own work through (separate from the recording threads, those
+	// have to finish every frame and a pipeline compile can take a long time). They all share the pipeline cache.
+	// Once the queue drains, shader modules nobody else is using get released.
+	class TvPipelineCompiler
+	{
+	public:
+		// 0 threads compiles right inside compile(), so every future comes back ready
+		TvPipelineCompiler(TvDevice& device, TvPipelineCache& pipelineCache, uint32_t threadCount);
+		// waits for whatever is compiling right now, anything still queued is dropped (its future throws broken_promise)
+		~TvPipelineCompiler();
+
+		TvPipelineCompiler(const TvPipelineCompiler&) = delete;
+		void operator=(const TvPipelineCompiler&) = delete;
+
+		PipelineFuture compile(PipelineRequest request);
+		// futures come back in the same order as the requests
+		std::vector<PipelineFuture> compile(std::vector<PipelineRequest> requests);
+		// same as compile, but whatever build does is run instead
+		PipelineFuture submit(PipelineBuild build);
+		std::vector<PipelineFuture> submit(std::vector<PipelineBuild> builds);
+
+		// the pipeline if it's done, nullptr if it's still compiling (rethrows if compiling it failed)
+		static std::shared_ptr<TvPipeline> ready(const PipelineFuture& future);
+		// queued + compiling right now
+		uint32_t pendingCount();
+		// blocks until everything queued so far is done
+		void waitIdle();
+		uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+	private:
+		using Job = std::packaged_task<std::shared_ptr<TvPipeline>()>;
+
+		Job makeJob(PipelineBuild build);
+		void workerLoop();
+
+		TvDevice& tvDevice;
+		TvPipelineCache& pipelineCache;
+		std::vector<std::thread> workers;
+
+		std::mutex mutex;
+		std::condition_variable jobReady;
+		std::condition_variable idle;
+		std::deque<Job> jobs;
+		uint32_t running = 0;
+		bool stopping = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "tv_pipeline_layout.hpp"
+#include "tv_hash.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+namespace tv
+{
+	PipelineLayoutDesc& PipelineLayoutDesc::addBinding(uint32_t set, uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages, uint32_t count)
+	{
+		Binding added{ set, binding, static_cast<uint32_t>(type), count, stages };
+		auto it = std::lower_bound(bindings.begin(), bindings.end(), added,
+			[](const Binding& a, const Binding& b) { return std::tie(a.set, a.binding) < std::tie(b.set, b.binding); });
+		if (it != bindings.end() && it->set == set && it->binding == binding)
+		{
+			throw std::runtime_error("binding " + std::to_string(binding) + " of descriptor set " + std::to_string(set) + " was added twice");
+		}
+		bindings.insert(it, added);
+		return *this;
+	}
+
+	PipelineLayoutDesc& PipelineLayoutDesc::addPushConstants(VkShaderStageFlags stages, uint32_t offset, uint32_t size)
+	{
+		if (size == 0 || size % 4 != 0 || offset % 4 != 0)
+		{
+			throw std::runtime_error("push constant ranges have to be a non-zero multiple of 4 bytes at a multiple of 4");
+		}
+		for (const VkPushConstantRange& range : pushConstants)
+		{
+			if (range.stageFlags & stages)
+			{
+				throw std::runtime_error("a shader stage can only be in one push constant range");
+			}
+		}
+		VkPushConstantRange added{ stages, offset, size };
+		auto it = std::lower_bound(pushConstants.begin(), pushConstants.end(), added,
+			[](const VkPushConstantRange& a, const VkPushConstantRange& b) { return std::tie(a.offset, a.size, a.stageFlags) < std::tie(b.offset, b.size, b.stageFlags); });
+		pushConstants.insert(it, added);
+		return *this;
+	}
+
+	uint32_t PipelineLayoutDesc::setCount() const
+	{
+		return bindings.empty() ? 0 : bindings.back().set + 1;
+	}
+
+	uint32_t PipelineLayoutDesc::pushConstantSize() const
+	{
+		uint32_t size = 0;
+		for (const VkPushConstantRange& range : pushConstants)
+		{
+			size = std::max(size, range.offset + range.size);
+		}
+		return size;
+	}
+
+	size_t TvLayoutCache::WordsHash::operator()(const Words& words) const
+	{
+		return static_cast<size_t>(fnv1a(words.data(), words.size() * sizeof(uint32_t)));
+	}
+
+	TvLayoutCache::TvLayoutCache(VkDevice device, uint32_t maxPushConstantsSize) : device{ device }, maxPushConstantsSize{ maxPushConstantsSize }
+	{
+	}
+
+	TvLayoutCache::~TvLayoutCache()
+	{
+		// pipeline layouts first, they were made from the set layouts
+		for (auto& entry : pipelineLayouts)
+		{
+			vkDestroyPipelineLayout(device, entry.second, nullptr);
+		}
+		for (auto& entry : setLayouts)
+		{
+			vkDestroyDescriptorSetLayout(device, entry.second, nullptr);
+		}
+	}
+
+	TvLayoutCache::Words TvLayoutCache::setWords(const PipelineLayoutDesc& desc, uint32_t set)
+	{
+		Words words;
+		for (const auto& binding : desc.bindings)
+		{
+			if (binding.set == set)
+			{
+				words.insert(words.end(), { binding.binding, binding.type, binding.count, binding.stages });
+			}
+		}
+		return words;
+	}
+
+	VkDescriptorSetLayout TvLayoutCache::getSetLayout(const Words& words)
+	{
+		auto it = setLayouts.find(words);
+		if (it != setLayouts.end())
+		{
+			return it->second;
+		}
+
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		for (size_t i = 0; i < words.size(); i += 4)
+		{
+			VkDescriptorSetLayoutBinding binding{};
+			binding.binding = words[i];
+			binding.descriptorType = static_cast<VkDescriptorType>(words[i + 1]);
+			binding.descriptorCount = words[i + 2];
+			binding.stageFlags = words[i + 3];
+			binding.pImmutableSamplers = nullptr;
+			bindings.push_back(binding);
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		VkDescriptorSetLayout setLayout;
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor set layout");
+		}
+		setLayouts.emplace(words, setLayout);
+		return setLayout;
+	}
+
+	VkPipelineLayout TvLayoutCache::get(const PipelineLayoutDesc& desc)
+	{
+		if (desc.pushConstantSize() > maxPushConstantsSize)
+		{
+			throw std::runtime_error("push constants need " + std::to_string(desc.pushConstantSize()) + " bytes, the device only has "
+				+ std::to_string(maxPushConstantsSize));
+		}
+
+		// each set's bindings (with how many words they take up first) and then the push constant ranges
+		Words key;
+		const uint32_t setCount = desc.setCount();
+		key.push_back(setCount);
+		for (uint32_t set = 0; set < setCount; set++)
+		{
+			Words words = setWords(desc, set);
+			key.push_back(static_cast<uint32_t>(words.size()));
+			key.insert(key.end(), words.begin(), words.end());
+		}
+		for (const VkPushConstantRange& range : desc.pushConstants)
+		{
+			key.insert(key.end(), { range.stageFlags, range.offset, range.size });
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto it = pipelineLayouts.find(key);
+		if (it != pipelineLayouts.end())
+		{
+			hits++;
+			return it->second;
+		}
+		misses++;
+
+		std::vector<VkDescriptorSetLayout> sets;
+		for (uint32_t set = 0; set < setCount; set++)
+		{
+			sets.push_back(getSetLayout(setWords(desc, set)));
+		}
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(sets.size());
+		pipelineLayoutInfo.pSetLayouts = sets.data();
+		pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(desc.pushConstants.size());
+		pipelineLayoutInfo.pPushConstantRanges = desc.pushConstants.data();
+
+		VkPipelineLayout pipelineLayout;
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline layout");
+		}
+		pipelineLayouts.emplace(std::move(key), pipelineLayout);
+		return pipelineLayout;
+	}
+
+	VkDescriptorSetLayout TvLayoutCache::setLayout(const PipelineLayoutDesc& desc, uint32_t set)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		return getSetLayout(setWords(desc, set));
+	}
+
+	TvLayoutCache::Stats TvLayoutCache::stats()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats stats;
+		stats.hits = hits;
+		stats.misses = misses;
+		stats.pipelineLayoutCount = static_cast<uint32_t>(pipelineLayouts.size());
+		stats.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		return stats;
+	}
+
+	void TvLayoutCache::printStats(std::ostream& out)
+	{
+		Stats s = stats();
+		out << "layouts: " << s.pipelineLayoutCount << " pipeline layouts, " << s.setLayoutCount << " set layouts, "
+			<< s.hits << " lookups hit, " << s.misses << " missed" << std::endl;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace tv
+{
+	// What a pipeline layout is made of: the bindings of each descriptor set and the push constant ranges
+	// Only the content counts, so two descs that end up with the same bindings and ranges (added in any order) get the
+	// same layout out of TvLayoutCache.
+	class PipelineLayoutDesc
+	{
+	public:
+		// adds a binding to descriptor set `set`, any sets below it that nothing gets added to are left empty
+		PipelineLayoutDesc& addBinding(uint32_t set, uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages, uint32_t count = 1);
+		// offset and size are in bytes and have to be multiples of 4, and each stage can only be in one range
+		PipelineLayoutDesc& addPushConstants(VkShaderStageFlags stages, uint32_t offset, uint32_t size);
+		// a range the size of T, which has to match the shader's push_constant block (std430 rules)
+		template <typename T>
+		PipelineLayoutDesc& addPushConstants(VkShaderStageFlags stages, uint32_t offset = 0)
+		{
+			static_assert(sizeof(T) % 4 == 0, "push constants are made of 4 byte words");
+			return addPushConstants(stages, offset, static_cast<uint32_t>(sizeof(T)));
+		}
+
+		uint32_t setCount() const;
+		// where the last push constant range ends
+		uint32_t pushConstantSize() const;
+	private:
+		friend class TvLayoutCache;
+
+		struct Binding
+		{
+			uint32_t set;
+			uint32_t binding;
+			uint32_t type;
+			uint32_t count;
+			uint32_t stages;
+		};
+		// sorted by set, then binding
+		std::vector<Binding> bindings;
+		// sorted by offset
+		std::vector<VkPushConstantRange> pushConstants;
+	};
+
+	// Creates (and owns) every descriptor set layout and pipeline layout on the device, one per distinct desc
+	// Asking again for a layout it already has hands back the same handle, so pipeline keys that only differ by which
+	// desc they were built from still match and share pipelines. Layouts live until the device goes away.
+	// Safe to call from multiple threads.
+	class TvLayoutCache
+	{
+	public:
+		struct Stats
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint32_t pipelineLayoutCount = 0;
+			uint32_t setLayoutCount = 0;
+		};
+
+		// throws on push constant ranges bigger than maxPushConstantsSize (128 bytes is all that's guaranteed)
+		TvLayoutCache(VkDevice device, uint32_t maxPushConstantsSize);
+		~TvLayoutCache();
+
+		TvLayoutCache(const TvLayoutCache&) = delete;
+		void operator=(const TvLayoutCache&) = delete;
+
+		VkPipelineLayout get(const PipelineLayoutDesc& desc);
+		// the layout of one of desc's descriptor sets, for allocating sets that go with it
+		VkDescriptorSetLayout setLayout(const PipelineLayoutDesc& desc, uint32_t set);
+
+		Stats stats();
+		void printStats(std::ostream& out);
+	private:
+		// descs flattened into words, which is what the maps are keyed by
+		using Words = std::vector<uint32_t>;
+		struct WordsHash
+		{
+			size_t operator()(const Words& words) const;
+		};
+
+		static Words setWords(const PipelineLayoutDesc& desc, uint32_t set);
+		// call with the lock held
+		VkDescriptorSetLayout getSetLayout(const Words& bindings);
+
+		VkDevice device;
+		uint32_t maxPushConstantsSize;
+
+		std::mutex mutex;
+		std::unordered_map<Words, VkDescriptorSetLayout, WordsHash> setLayouts;
+		std::unordered_map<Words, VkPipelineLayout, WordsHash> pipelineLayouts;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+}
\ No newline at end of file
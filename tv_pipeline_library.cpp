@@ -0,0 +1,192 @@
+#include "tv_pipeline_library.hpp"
+
+// std
+#include <chrono>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <vector>
+
+namespace tv
+{
+	namespace
+	{
+		const VkGraphicsPipelineLibraryFlagsEXT PART_FLAGS[] = {
+			VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+			VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+			VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+			VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+		};
+	}
+
+	TvPipelineLibrary::TvPipelineLibrary(TvDevice& device, TvPipelineCache& pipelineCache)
+		: tvDevice{ device }, pipelineCache{ pipelineCache }
+	{
+	}
+
+	PipelineKey TvPipelineLibrary::partKey(PartType type, const PipelineKey& key)
+	{
+		PipelineKey part;
+		// extended dynamic state moves topology, cull/front face and depth state out of all three of these
+		part.extendedDynamicState = key.extendedDynamicState;
+		switch (type)
+		{
+		case VertexInput:
+			part.topology = key.topology;
+			part.vertexLayout = key.vertexLayout;
+			part.instanced = key.instanced;
+			break;
+		case PreRasterization:
+			part.renderPass = key.renderPass;
+			part.pipelineLayout = key.pipelineLayout;
+			part.subpass = key.subpass;
+			part.program = key.program;
+			part.specialization = key.specialization;
+			part.polygonMode = key.polygonMode;
+			part.cullMode = key.cullMode;
+			part.frontFace = key.frontFace;
+			break;
+		case FragmentShader:
+			part.renderPass = key.renderPass;
+			part.pipelineLayout = key.pipelineLayout;
+			part.subpass = key.subpass;
+			part.program = key.program;
+			part.specialization = key.specialization;
+			part.depthTest = key.depthTest;
+			part.depthWrite = key.depthWrite;
+			part.depthCompareOp = key.depthCompareOp;
+			part.rasterizationSamples = key.rasterizationSamples;
+			break;
+		case FragmentOutput:
+			part.extendedDynamicState = VK_FALSE;
+			part.renderPass = key.renderPass;
+			part.subpass = key.subpass;
+			part.blendEnable = key.blendEnable;
+			part.srcColorBlendFactor = key.srcColorBlendFactor;
+			part.dstColorBlendFactor = key.dstColorBlendFactor;
+			part.colorBlendOp = key.colorBlendOp;
+			part.srcAlphaBlendFactor = key.srcAlphaBlendFactor;
+			part.dstAlphaBlendFactor = key.dstAlphaBlendFactor;
+			part.alphaBlendOp = key.alphaBlendOp;
+			part.colorWriteMask = key.colorWriteMask;
+			part.rasterizationSamples = key.rasterizationSamples;
+			break;
+		default:
+			break;
+		}
+		return part;
+	}
+
+	bool TvPipelineLibrary::hasShaderParts(const PipelineKey& key)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		for (PartType type : { PreRasterization, FragmentShader })
+		{
+			auto it = parts[type].find(partKey(type, key));
+			if (it == parts[type].end() || it->second.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::shared_ptr<TvPipeline> TvPipelineLibrary::part(PartType type, const PipelineKey& key, const PipelineRequest& request)
+	{
+		PipelineKey masked = partKey(type, key);
+		std::promise<std::shared_ptr<TvPipeline>> built;
+		PipelineFuture future;
+		bool building = false;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			auto it = parts[type].find(masked);
+			if (it != parts[type].end())
+			{
+				future = it->second;
+			}
+			else
+			{
+				future = built.get_future().share();
+				parts[type].emplace(masked, future);
+				partsBuilt++;
+				building = true;
+			}
+		}
+
+		// we're the ones building it (outside the lock, the shader parts are the slow ones). a failure stays cached
+		// like it does in the table, until forgetProgram/evict
+		if (building)
+		{
+			try
+			{
+				built.set_value(std::make_shared<TvPipeline>(tvDevice, PART_FLAGS[type], request.vertFilepath, request.fragFilepath, request.config, pipelineCache.cache()));
+				pipelineCache.markDirty();
+			}
+			catch (...)
+			{
+				built.set_exception(std::current_exception());
+			}
+		}
+		return future.get();
+	}
+
+	std::shared_ptr<TvPipeline> TvPipelineLibrary::link(const PipelineKey& key, const PipelineRequest& request, bool optimize)
+	{
+		std::vector<std::shared_ptr<TvPipeline>> libraries;
+		for (int type = 0; type < PART_TYPE_COUNT; type++)
+		{
+			libraries.push_back(part(static_cast<PartType>(type), key, request));
+		}
+		auto pipeline = std::make_shared<TvPipeline>(tvDevice, std::move(libraries), key.pipelineLayout, key.extendedDynamicState != VK_FALSE, optimize, pipelineCache.cache());
+		pipelineCache.markDirty();
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		(optimize ? optimizedLinks : fastLinks)++;
+		return pipeline;
+	}
+
+	void TvPipelineLibrary::forgetProgram(uint32_t program)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		for (PartType type : { PreRasterization, FragmentShader })
+		{
+			for (auto it = parts[type].begin(); it != parts[type].end();)
+			{
+				it = it->first.program == program ? parts[type].erase(it) : std::next(it);
+			}
+		}
+	}
+
+	void TvPipelineLibrary::evict(VkRenderPass renderPass)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		for (auto& typeParts : parts)
+		{
+			for (auto it = typeParts.begin(); it != typeParts.end();)
+			{
+				it = it->first.renderPass == renderPass ? typeParts.erase(it) : std::next(it);
+			}
+		}
+	}
+
+	TvPipelineLibrary::Stats TvPipelineLibrary::stats()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats stats;
+		for (auto& typeParts : parts)
+		{
+			stats.partCount += static_cast<uint32_t>(typeParts.size());
+		}
+		stats.partsBuilt = partsBuilt;
+		stats.fastLinks = fastLinks;
+		stats.optimizedLinks = optimizedLinks;
+		return stats;
+	}
+
+	void TvPipelineLibrary::printStats(std::ostream& out)
+	{
+		Stats s = stats();
+		out << "pipeline library: " << s.partCount << " parts (" << s.partsBuilt << " built), " << s.fastLinks << " fast links, "
+			<< s.optimizedLinks << " optimized links" << std::endl;
+	}
+}
\ No newline at end of file
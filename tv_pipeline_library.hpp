@@ -0,0 +1,74 @@
+#pragma once
+#include "tv_device.hpp"
+#include "tv_pipeline.hpp"
+#include "tv_pipeline_cache.hpp"
+#include "tv_pipeline_compiler.hpp"
+#include "tv_pipeline_table.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+namespace tv
+{
+	// Builds pipelines out of separately compiled parts (VK_EXT_graphics_pipeline_library) and keeps the parts around
+	// A pipeline is split into vertex input, pre-rasterization (the vert shader), fragment shader and fragment output, and
+	// each part only depends on some of the PipelineKey. So a new blend mode reuses the compiled shaders and only needs a
+	// tiny new fragment output part, and the link that puts the four together is quick enough to do in the middle of a frame.
+	// Fast links can run a little slower on the gpu, TvPipelineTable replaces them with an optimized link in the background.
+	// Only make one when TvDevice::supportsGraphicsPipelineLibrary. Safe to use from multiple threads.
+	class TvPipelineLibrary
+	{
+	public:
+		struct Stats
+		{
+			uint32_t partCount = 0;
+			uint64_t partsBuilt = 0;
+			uint64_t fastLinks = 0;
+			uint64_t optimizedLinks = 0;
+		};
+
+		TvPipelineLibrary(TvDevice& device, TvPipelineCache& pipelineCache);
+
+		TvPipelineLibrary(const TvPipelineLibrary&) = delete;
+		void operator=(const TvPipelineLibrary&) = delete;
+
+		// true if the shader parts for key are built already, so link() only has the cheap parts and the link left
+		bool hasShaderParts(const PipelineKey& key);
+		// builds whatever parts key is missing (request is what TvPipelineTable would compile for it) and links them
+		std::shared_ptr<TvPipeline> link(const PipelineKey& key, const PipelineRequest& request, bool optimize);
+		// forgets the shader parts of program (its shaders changed), the next link builds them again
+		void forgetProgram(uint32_t program);
+		// forgets every part made for renderPass, pipelines linked from them keep them alive for as long as they need
+		void evict(VkRenderPass renderPass);
+
+		Stats stats();
+		void printStats(std::ostream& out);
+	private:
+		enum PartType
+		{
+			VertexInput,
+			PreRasterization,
+			FragmentShader,
+			FragmentOutput,
+			PART_TYPE_COUNT
+		};
+
+		// key with only the fields that part depends on, the rest left at their defaults
+		static PipelineKey partKey(PartType type, const PipelineKey& key);
+		// builds it the first time, anyone else asking for it meanwhile waits for that build instead of doing their own
+		std::shared_ptr<TvPipeline> part(PartType type, const PipelineKey& key, const PipelineRequest& request);
+
+		TvDevice& tvDevice;
+		TvPipelineCache& pipelineCache;
+
+		std::mutex mutex;
+		std::unordered_map<PipelineKey, PipelineFuture, PipelineKeyHash> parts[PART_TYPE_COUNT];
+		uint64_t partsBuilt = 0;
+		uint64_t fastLinks = 0;
+		uint64_t optimizedLinks = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "tv_pipeline_table.hpp"
+#include "tv_pipeline_library.hpp"
+#include "tv_hash.hpp"
+
+// std
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+namespace tv
+{
+	namespace
+	{
+		// links key from the library's parts on one of the compiler's threads
+		PipelineBuild linkLater(TvPipelineLibrary* library, const PipelineKey& key, PipelineRequest request, bool optimize)
+		{
+			return [library, key, request = std::move(request), optimize](VkPipelineCache)
+			{
+				return library->link(key, request, optimize);
+			};
+		}
+
+		// done, and didn't throw
+		bool succeeded(const PipelineFuture& future)
+		{
+			try
+			{
+				return TvPipelineCompiler::ready(future) != nullptr;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		}
+	}
+
+	void PipelineKey::toConfigInfo(PipelineConfigInfo& configInfo) const
+	{
+		TvPipeline::defaultPipelineConfigInfo(configInfo);
+		configInfo.renderPass = renderPass;
+		configInfo.pipelineLayout = pipelineLayout;
+		configInfo.subpass = subpass;
+
+		configInfo.inputAssemblyInfo.topology = static_cast<VkPrimitiveTopology>(topology);
+		configInfo.rasterizationInfo.polygonMode = static_cast<VkPolygonMode>(polygonMode);
+		configInfo.rasterizationInfo.cullMode = cullMode;
+		configInfo.rasterizationInfo.frontFace = static_cast<VkFrontFace>(frontFace);
+		configInfo.multisampleInfo.rasterizationSamples = static_cast<VkSampleCountFlagBits>(rasterizationSamples);
+		configInfo.depthStencilInfo.depthTestEnable = depthTest;
+		configInfo.depthStencilInfo.depthWriteEnable = depthWrite;
+		configInfo.depthStencilInfo.depthCompareOp = static_cast<VkCompareOp>(depthCompareOp);
+
+		configInfo.colorBlendAttachment.blendEnable = blendEnable;
+		configInfo.colorBlendAttachment.srcColorBlendFactor = static_cast<VkBlendFactor>(srcColorBlendFactor);
+		configInfo.colorBlendAttachment.dstColorBlendFactor = static_cast<VkBlendFactor>(dstColorBlendFactor);
+		configInfo.colorBlendAttachment.colorBlendOp = static_cast<VkBlendOp>(colorBlendOp);
+		configInfo.colorBlendAttachment.srcAlphaBlendFactor = static_cast<VkBlendFactor>(srcAlphaBlendFactor);
+		configInfo.colorBlendAttachment.dstAlphaBlendFactor = static_cast<VkBlendFactor>(dstAlphaBlendFactor);
+		configInfo.colorBlendAttachment.alphaBlendOp = static_cast<VkBlendOp>(alphaBlendOp);
+		configInfo.colorBlendAttachment.colorWriteMask = colorWriteMask;
+
+		configInfo.extendedDynamicState = extendedDynamicState;
+		TvModel::vertexInputDescriptions(static_cast<VertexLayout>(vertexLayout), configInfo.bindingDescriptions, configInfo.attributeDescriptions);
+		if (instanced)
+		{
+			TvInstanceBuffer::appendInputDescriptions(configInfo.bindingDescriptions, configInfo.attributeDescriptions);
+		}
+	}
+
+	bool PipelineKey::operator==(const PipelineKey& other) const
+	{
+		return std::memcmp(this, &other, sizeof(PipelineKey)) == 0;
+	}
+
+	size_t PipelineKeyHash::operator()(const PipelineKey& key) const
+	{
+		return static_cast<size_t>(fnv1a(&key, sizeof(key)));
+	}
+
+	TvPipelineTable::TvPipelineTable(TvPipelineCompiler& compiler, TvPipelineLibrary* library) : compiler{ compiler }, library{ library }
+	{
+		// id 0 is no specialization
+		specializations.emplace_back();
+		specializationIds.emplace(specializations.back(), 0);
+	}
+
+	uint32_t TvPipelineTable::program(const std::string& vertFilepath, const std::string& fragFilepath)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto names = std::make_pair(vertFilepath, fragFilepath);
+		auto it = programIds.find(names);
+		if (it != programIds.end())
+		{
+			return it->second;
+		}
+		uint32_t id = static_cast<uint32_t>(programs.size());
+		programs.push_back(names);
+		programIds.emplace(std::move(names), id);
+		return id;
+	}
+
+	uint32_t TvPipelineTable::specialization(const SpecializationConstants& vert, const SpecializationConstants& frag)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto constants = std::make_pair(vert, frag);
+		auto it = specializationIds.find(constants);
+		if (it != specializationIds.end())
+		{
+			return it->second;
+		}
+		uint32_t id = static_cast<uint32_t>(specializations.size());
+		specializations.push_back(constants);
+		specializationIds.emplace(std::move(constants), id);
+		return id;
+	}
+
+	PipelineRequest TvPipelineTable::makeRequest(const PipelineKey& key)
+	{
+		if (key.program >= programs.size())
+		{
+			throw std::runtime_error("pipeline key has an unknown program id " + std::to_string(key.program));
+		}
+		if (key.specialization >= specializations.size())
+		{
+			throw std::runtime_error("pipeline key has an unknown specialization id " + std::to_string(key.specialization));
+		}
+		PipelineRequest request;
+		request.vertFilepath = programs[key.program].first;
+		request.fragFilepath = programs[key.program].second;
+		request.config.vertSpecialization = specializations[key.specialization].first;
+		request.config.fragSpecialization = specializations[key.specialization].second;
+		key.toConfigInfo(request.config);
+		return request;
+	}
+
+	PipelineFuture TvPipelineTable::get(const PipelineKey& key)
+	{
+		return lookup(key, true);
+	}
+
+	PipelineFuture TvPipelineTable::poll(const PipelineKey& key)
+	{
+		return lookup(key, false);
+	}
+
+	PipelineFuture TvPipelineTable::lookup(const PipelineKey& key, bool counted)
+	{
+		PipelineRequest request;
+		PipelineFuture current;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			auto it = pipelines.find(key);
+			if (it != pipelines.end())
+			{
+				hits += counted ? 1 : 0;
+				// a reload (or optimized link) that has finished takes over from here on, the old one is retired
+				auto replacement = replacements.find(key);
+				if (replacement != replacements.end() && replacement->second.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready)
+				{
+					try
+					{
+						replacement->second.get();
+						retired.push_back(std::move(it->second));
+						it->second = std::move(replacement->second);
+					}
+					catch (const std::exception& e)
+					{
+						// a broken shader shouldn't take down what was working, keep using the old one
+						std::cerr << "replacement pipeline failed to build, keeping the old one: " << e.what() << std::endl;
+					}
+					replacements.erase(replacement);
+				}
+
+				// a fast link that worked gets an optimized one queued up to replace it (unless a reload already is)
+				auto fastLinked = unoptimized.find(key);
+				if (fastLinked == unoptimized.end() || replacements.count(key) != 0 || !succeeded(it->second))
+				{
+					return it->second;
+				}
+				unoptimized.erase(fastLinked);
+				current = it->second;
+			}
+			else
+			{
+				misses += counted ? 1 : 0;
+			}
+			request = makeRequest(key);
+		}
+
+		if (current.valid())
+		{
+			optimize(key, std::move(request));
+			return current;
+		}
+
+		// queued outside the lock (with no compile threads this builds it right here), two threads missing on the
+		// same key at once both compile it but only the first one to get back in is kept
+		PipelineFuture future = library != nullptr ? fastLink(key, std::move(request)) : compiler.compile(std::move(request));
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto inserted = pipelines.emplace(key, std::move(future));
+		if (inserted.second && library != nullptr)
+		{
+			unoptimized.insert(key);
+		}
+		return inserted.first->second;
+	}
+
+	PipelineFuture TvPipelineTable::fastLink(const PipelineKey& key, PipelineRequest request)
+	{
+		if (library->hasShaderParts(key))
+		{
+			// only the cheap parts and the link itself are left, so do it right here and the pipeline is usable this frame
+			std::promise<std::shared_ptr<TvPipeline>> linked;
+			try
+			{
+				linked.set_value(library->link(key, request, false));
+			}
+			catch (...)
+			{
+				linked.set_exception(std::current_exception());
+			}
+			return linked.get_future().share();
+		}
+		// the shaders still have to compile, that goes in the background like any other compile
+		return compiler.submit(linkLater(library, key, std::move(request), false));
+	}
+
+	void TvPipelineTable::optimize(const PipelineKey& key, PipelineRequest request)
+	{
+		PipelineFuture future = compiler.submit(linkLater(library, key, std::move(request), true));
+		std::lock_guard<std::mutex> lock{ mutex };
+		// a reload that got in meanwhile wins, it'll get optimized after it's swapped in
+		replacements.emplace(key, std::move(future));
+	}
+
+	uint32_t TvPipelineTable::reload(const std::string& shaderFilepath)
+	{
+		std::vector<PipelineKey> keys;
+		std::vector<PipelineRequest> requests;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			if (library != nullptr)
+			{
+				// the old shader parts would just get linked again
+				for (uint32_t program = 0; program < programs.size(); program++)
+				{
+					if (programs[program].first == shaderFilepath || programs[program].second == shaderFilepath)
+					{
+						library->forgetProgram(program);
+					}
+				}
+			}
+			for (auto& entry : pipelines)
+			{
+				const auto& shaders = programs[entry.first.program];
+				if (shaders.first == shaderFilepath || shaders.second == shaderFilepath)
+				{
+					keys.push_back(entry.first);
+					requests.push_back(makeRequest(entry.first));
+				}
+			}
+		}
+
+		std::vector<PipelineFuture> futures;
+		if (library != nullptr)
+		{
+			std::vector<PipelineBuild> builds;
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				builds.push_back(linkLater(library, keys[i], std::move(requests[i]), false));
+			}
+			futures = compiler.submit(std::move(builds));
+		}
+		else
+		{
+			futures = compiler.compile(std::move(requests));
+		}
+		std::lock_guard<std::mutex> lock{ mutex };
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			// a newer reload wins over one that's still compiling
+			replacements[keys[i]] = std::move(futures[i]);
+			if (library != nullptr)
+			{
+				unoptimized.insert(keys[i]);
+			}
+		}
+		return static_cast<uint32_t>(keys.size());
+	}
+
+	std::vector<PipelineFuture> TvPipelineTable::takeRetired()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		std::vector<PipelineFuture> taken;
+		taken.swap(retired);
+		return taken;
+	}
+
+	std::vector<PipelineFuture> TvPipelineTable::evict(VkRenderPass renderPass)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		std::vector<PipelineFuture> evicted;
+		for (auto it = pipelines.begin(); it != pipelines.end();)
+		{
+			if (it->first.renderPass == renderPass)
+			{
+				evicted.push_back(std::move(it->second));
+				it = pipelines.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		for (auto it = replacements.begin(); it != replacements.end();)
+		{
+			if (it->first.renderPass == renderPass)
+			{
+				evicted.push_back(std::move(it->second));
+				it = replacements.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		for (auto it = unoptimized.begin(); it != unoptimized.end();)
+		{
+			it = it->renderPass == renderPass ? unoptimized.erase(it) : std::next(it);
+		}
+		if (library != nullptr)
+		{
+			library->evict(renderPass);
+		}
+		return evicted;
+	}
+
+	TvPipelineTable::Stats TvPipelineTable::stats()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats stats;
+		stats.hits = hits;
+		stats.misses = misses;
+		for (const auto& entry : pipelines)
+		{
+			if (entry.second.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready)
+			{
+				stats.pendingCount++;
+			}
+			else if (succeeded(entry.second))
+			{
+				stats.builtCount++;
+			}
+			else
+			{
+				stats.failedCount++;
+			}
+		}
+		return stats;
+	}
+
+	void TvPipelineTable::printStats(std::ostream& out)
+	{
+		Stats s = stats();
+		out << "pipelines: " << s.builtCount << " built, " << s.pendingCount << " pending, " << s.failedCount << " failed, "
+			<< s.hits << " requests hit, " << s.misses << " missed" << std::endl;
+	}
+}
\ No newline at end of file
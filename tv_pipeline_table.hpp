@@ -0,0 +1,149 @@
+#pragma once
+#include "tv_pipeline.hpp"
+#include "tv_pipeline_compiler.hpp"
+#include "tv_model.hpp"
+#include "tv_instance_buffer.hpp"
+
+// std
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace tv
+{
+	// Everything that makes one pipeline different from another, packed into 48 bytes of plain data
+	// No pointers into itself and no padding, so it can be copied, compared and hashed as raw bytes.
+	// It only gets expanded into the real create info structs (toConfigInfo) when the pipeline has to be built.
+	// Defaults match TvPipeline::defaultPipelineConfigInfo. The state is stored as bytes, which holds every core enum
+	// value (vendor extension values like VK_POLYGON_MODE_FILL_RECTANGLE_NV don't fit).
+	struct PipelineKey
+	{
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		// which shaders, from TvPipelineTable::program
+		uint32_t program = 0;
+		// their specialization constants, from TvPipelineTable::specialization (0 is none)
+		uint32_t specialization = 0;
+
+		uint8_t topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		uint8_t polygonMode = VK_POLYGON_MODE_FILL;
+		uint8_t cullMode = VK_CULL_MODE_NONE;
+		uint8_t frontFace = VK_FRONT_FACE_CLOCKWISE;
+		uint8_t depthTest = VK_TRUE;
+		uint8_t depthWrite = VK_TRUE;
+		uint8_t depthCompareOp = VK_COMPARE_OP_LESS;
+		uint8_t blendEnable = VK_FALSE;
+		uint8_t srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		uint8_t dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+		uint8_t colorBlendOp = VK_BLEND_OP_ADD;
+		uint8_t srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		uint8_t dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		uint8_t alphaBlendOp = VK_BLEND_OP_ADD;
+		uint8_t colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		uint8_t rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		uint8_t subpass = 0;
+		// see PipelineConfigInfo::extendedDynamicState, the cull/front face/topology/depth values are ignored then
+		uint8_t extendedDynamicState = VK_FALSE;
+		// a VertexLayout, what the vertex buffers look like
+		uint8_t vertexLayout = static_cast<uint8_t>(VertexLayout::None);
+		// VK_TRUE reads TvInstanceBuffer::InstanceData per instance as well
+		uint8_t instanced = VK_FALSE;
+		uint8_t reserved[4] = {};
+
+		// the create info for this key (shader paths and specialization constants aren't part of it, the table keeps those)
+		void toConfigInfo(PipelineConfigInfo& configInfo) const;
+
+		bool operator==(const PipelineKey& other) const;
+		bool operator!=(const PipelineKey& other) const { return !(*this == other); }
+	};
+	static_assert(std::is_trivially_copyable<PipelineKey>::value, "PipelineKey gets copied around as bytes");
+	static_assert(std::has_unique_object_representations<PipelineKey>::value, "PipelineKey can't have padding, it's hashed as bytes");
+
+	struct PipelineKeyHash
+	{
+		size_t operator()(const PipelineKey& key) const;
+	};
+
+	// Hands out one pipeline per distinct PipelineKey, building it (on the compiler) the first time it's asked for
+	// Asking again is a hash lookup that returns the same future, so the same state is never built twice. Safe to use
+	// from multiple threads.
+	// reload() rebuilds pipelines in the background when a shader changes, get() keeps returning the old one until the
+	// new one is ready and then swaps it in, so a reload never stalls a frame.
+	// With a TvPipelineLibrary, new keys are linked from prebuilt parts instead (right inside get() when the shaders are
+	// already built), and each fast link is swapped for an optimized one the same way a reload is.
+	class TvPipelineLibrary;
+	class TvPipelineTable
+	{
+	public:
+		struct Stats
+		{
+			// get() calls that found the key already there, and ones that had to build it (poll() isn't counted)
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint32_t builtCount = 0;
+			// still compiling (or linking)
+			uint32_t pendingCount = 0;
+			uint32_t failedCount = 0;
+		};
+
+		// library is optional (nullptr compiles every pipeline whole), it has to outlive the table
+		explicit TvPipelineTable(TvPipelineCompiler& compiler, TvPipelineLibrary* library = nullptr);
+
+		TvPipelineTable(const TvPipelineTable&) = delete;
+		void operator=(const TvPipelineTable&) = delete;
+
+		// an id for a vert/frag pair to put in PipelineKey::program, the same pair always gets the same id
+		uint32_t program(const std::string& vertFilepath, const std::string& fragFilepath);
+		// an id for a set of specialization constants to put in PipelineKey::specialization, equal sets get the same id
+		uint32_t specialization(const SpecializationConstants& vert, const SpecializationConstants& frag);
+		// the pipeline for key, queued up for compiling if it's new (check it with TvPipelineCompiler::ready)
+		PipelineFuture get(const PipelineKey& key);
+		// the same as get(), for asking about a key over and over (every frame) until it's ready or swapped out, so
+		// the hit count only says how often a new request found an existing pipeline
+		PipelineFuture poll(const PipelineKey& key);
+		// rebuilds every pipeline that uses this shader (a program's vert or frag path), returns how many
+		uint32_t reload(const std::string& shaderFilepath);
+		// pipelines that reload() replaced since the last call, keep them alive until the frames using them retire
+		std::vector<PipelineFuture> takeRetired();
+		// forgets every pipeline made for renderPass (it's going away) and hands them back, so the caller can keep them
+		// alive until the gpu is done with them
+		std::vector<PipelineFuture> evict(VkRenderPass renderPass);
+
+		Stats stats();
+		void printStats(std::ostream& out);
+	private:
+		// what the compiler needs to build key (call with the lock held)
+		PipelineRequest makeRequest(const PipelineKey& key);
+		// get() and poll(), only get() counts towards hits and misses
+		PipelineFuture lookup(const PipelineKey& key, bool counted);
+
+		// the fast linked pipeline for key, or its future if the shader parts still have to be built
+		PipelineFuture fastLink(const PipelineKey& key, PipelineRequest request);
+		// the background link that replaces a fast linked one
+		void optimize(const PipelineKey& key, PipelineRequest request);
+
+		TvPipelineCompiler& compiler;
+		TvPipelineLibrary* library;
+
+		std::mutex mutex;
+		std::unordered_map<PipelineKey, PipelineFuture, PipelineKeyHash> pipelines;
+		// reloads still compiling, swapped into pipelines by get() once they're done
+		std::unordered_map<PipelineKey, PipelineFuture, PipelineKeyHash> replacements;
+		std::vector<PipelineFuture> retired;
+		// fast linked pipelines that haven't had an optimized link queued yet
+		std::unordered_set<PipelineKey, PipelineKeyHash> unoptimized;
+		std::map<std::pair<std::string, std::string>, uint32_t> programIds;
+		std::vector<std::pair<std::string, std::string>> programs;
+		std::map<std::pair<SpecializationConstants, SpecializationConstants>, uint32_t> specializationIds;
+		std::vector<std::pair<SpecializationConstants, SpecializationConstants>> specializations;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "tv_shader_bundle.hpp"
+#include "tv_shader_registry.hpp"
+#include "tv_hash.hpp"
+
+// std
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+namespace tv
+{
+	TvShaderBundle::TvShaderBundle(const std::string& filepath) : file{ filepath }
+	{
+		const char* base = static_cast<const char*>(file.data());
+		if (file.size() < sizeof(FileHeader))
+		{
+			throw std::runtime_error("shader bundle is too small: " + filepath);
+		}
+		FileHeader header;
+		std::memcpy(&header, base, sizeof(header));
+		if (header.magic != FILE_MAGIC || header.version != FILE_VERSION)
+		{
+			throw std::runtime_error("not a shader bundle (or a different version): " + filepath);
+		}
+		if (header.entryCount > (file.size() - sizeof(FileHeader)) / sizeof(Entry))
+		{
+			throw std::runtime_error("shader bundle index is truncated: " + filepath);
+		}
+
+		const Entry* entries = reinterpret_cast<const Entry*>(base + sizeof(FileHeader));
+		for (uint32_t i = 0; i < header.entryCount; i++)
+		{
+			const Entry& entry = entries[i];
+			std::string name{ entry.name, strnlen(entry.name, sizeof(entry.name)) };
+			if (entry.offset % 4 != 0 || entry.offset > file.size() || entry.size > file.size() - entry.offset)
+			{
+				throw std::runtime_error("shader bundle entry " + name + " is out of range: " + filepath);
+			}
+			Stage stage{ reinterpret_cast<const uint32_t*>(base + entry.offset), static_cast<size_t>(entry.size), entry.hash };
+			validateSpirv(stage.code, stage.size, name);
+			if (!stages.emplace(name, stage).second)
+			{
+				throw std::runtime_error("shader bundle has two stages called " + name + ": " + filepath);
+			}
+		}
+	}
+
+	const TvShaderBundle::Stage* TvShaderBundle::find(const std::string& name) const
+	{
+		auto it = stages.find(name);
+		return it == stages.end() ? nullptr : &it->second;
+	}
+
+	void TvShaderBundle::pack(const std::string& outPath, const std::vector<std::string>& spvPaths)
+	{
+		// map everything first so a bad input fails before we touch the output
+		std::vector<std::unique_ptr<TvMappedFile>> inputs;
+		std::vector<Entry> entries(spvPaths.size());
+		uint64_t offset = sizeof(FileHeader) + sizeof(Entry) * entries.size();
+		for (size_t i = 0; i < spvPaths.size(); i++)
+		{
+			inputs.push_back(std::make_unique<TvMappedFile>(spvPaths[i]));
+			const TvMappedFile& input = *inputs.back();
+			validateSpirv(input.data(), input.size(), spvPaths[i]);
+
+			std::string name = spvPaths[i].substr(spvPaths[i].find_last_of("/\\") + 1);
+			if (name.size() >= sizeof(Entry::name))
+			{
+				throw std::runtime_error("shader name is too long for a bundle: " + name);
+			}
+			Entry& entry = entries[i];
+			std::memset(&entry, 0, sizeof(entry));
+			std::memcpy(entry.name, name.c_str(), name.size());
+			offset = (offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+			entry.offset = offset;
+			entry.size = input.size();
+			entry.hash = fnv1a(input.data(), input.size());
+			offset += input.size();
+		}
+
+		FileHeader header{ FILE_MAGIC, FILE_VERSION, static_cast<uint32_t>(entries.size()), 0 };
+		std::ofstream out{ outPath, std::ios::binary | std::ios::trunc };
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(entries.data()), sizeof(Entry) * entries.size());
+		uint64_t written = sizeof(FileHeader) + sizeof(Entry) * entries.size();
+		const char padding[DATA_ALIGNMENT] = {};
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			out.write(padding, entries[i].offset - written);
+			out.write(static_cast<const char*>(inputs[i]->data()), entries[i].size);
+			written = entries[i].offset + entries[i].size;
+		}
+		out.flush();
+		if (!out)
+		{
+			throw std::runtime_error("failed to write shader bundle: " + outPath);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+#include "tv_mapped_file.hpp"
+
+// std
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tv
+{
+	// Lots of SPIR-V packed into one file, so loading every shader is one open and one map instead of one per stage
+	// Layout: FileHeader, entryCount Entries, then the SPIR-V blobs (each 16 byte aligned). Everything is validated
+	// when it's opened, after that stages point straight into the mapping (the bundle has to outlive them).
+	// Make one with pack() (or --pack-shaders, the build does this after compiling the shaders).
+	class TvShaderBundle
+	{
+	public:
+		// one shader stage inside the bundle
+		struct Stage
+		{
+			const uint32_t* code;
+			// bytes
+			size_t size;
+			// fnv1a of the code, computed when packing so loading doesn't have to
+			uint64_t hash;
+		};
+
+		explicit TvShaderBundle(const std::string& filepath);
+
+		TvShaderBundle(const TvShaderBundle&) = delete;
+		void operator=(const TvShaderBundle&) = delete;
+
+		// nullptr if there's no stage with that name
+		const Stage* find(const std::string& name) const;
+		size_t stageCount() const { return stages.size(); }
+		const std::string& path() const { return file.path(); }
+
+		// writes a bundle containing each .spv file, named by its file name (no directories)
+		static void pack(const std::string& outPath, const std::vector<std::string>& spvPaths);
+	private:
+		struct FileHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t entryCount;
+			uint32_t reserved;
+		};
+		struct Entry
+		{
+			char name[64];	// nul terminated
+			uint64_t offset;	// from the start of the file
+			uint64_t size;
+			uint64_t hash;
+		};
+		static constexpr uint32_t FILE_MAGIC = 0x42535654;	// "TVSB"
+		static constexpr uint32_t FILE_VERSION = 1;
+		static constexpr uint64_t DATA_ALIGNMENT = 16;
+
+		TvMappedFile file;
+		std::unordered_map<std::string, Stage> stages;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "tv_shader_registry.hpp"
+#include "tv_hash.hpp"
+#include "tv_mapped_file.hpp"
+
+// std
+#include <stdexcept>
+
+namespace tv
+{
+	void validateSpirv(const void* code, size_t size, const std::string& name)
+	{
+		// 5 word header: magic, version, generator, bound, schema
+		constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+		constexpr size_t SPIRV_HEADER_SIZE = 5 * sizeof(uint32_t);
+		if (size < SPIRV_HEADER_SIZE || size % sizeof(uint32_t) != 0)
+		{
+			throw std::runtime_error(name + " is not SPIR-V (size " + std::to_string(size) + ")");
+		}
+		if (reinterpret_cast<uintptr_t>(code) % alignof(uint32_t) != 0)
+		{
+			throw std::runtime_error(name + " is not 4 byte aligned");
+		}
+		// vulkan wants it in host byte order, a byte swapped magic doesn't count
+		if (*static_cast<const uint32_t*>(code) != SPIRV_MAGIC)
+		{
+			throw std::runtime_error(name + " is not SPIR-V (bad magic number)");
+		}
+	}
+
+	TvShaderModule::TvShaderModule(VkDevice device, const uint32_t* code, size_t size) : device{ device }, size{ size }
+	{
+		// creating shader module from byte array is surprisingly easy (it's already compiled ig)
+		VkShaderModuleCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = size;
+		createInfo.pCode = code;
+
+		if (vkCreateShaderModule(device, &createInfo, nullptr, &module) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shader module");
+		}
+	}
+
+	TvShaderModule::~TvShaderModule()
+	{
+		vkDestroyShaderModule(device, module, nullptr);
+	}
+
+	TvShaderRegistry::TvShaderRegistry(VkDevice device) : device{ device }
+	{
+	}
+
+	void TvShaderRegistry::mount(std::shared_ptr<TvShaderBundle> bundle)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		bundles.push_back(std::move(bundle));
+	}
+
+	void TvShaderRegistry::preferFile(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		preferredFiles.insert(name);
+	}
+
+	std::shared_ptr<TvShaderModule> TvShaderRegistry::load(const std::string& name)
+	{
+		// bundles stay mounted (and mapped) forever, so the stage is still there after we let go of the lock
+		const TvShaderBundle::Stage* stage = nullptr;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			bool fromFile = preferredFiles.count(name) != 0;
+			for (auto it = bundles.rbegin(); it != bundles.rend() && stage == nullptr && !fromFile; ++it)
+			{
+				stage = (*it)->find(name);
+			}
+		}
+		if (stage != nullptr)
+		{
+			return get(stage->code, stage->size, stage->hash);
+		}
+
+		TvMappedFile file{ name };
+		validateSpirv(file.data(), file.size(), name);
+		return get(static_cast<const uint32_t*>(file.data()), file.size(), fnv1a(file.data(), file.size()));
+	}
+
+	std::shared_ptr<TvShaderModule> TvShaderRegistry::get(const uint32_t* code, size_t size)
+	{
+		validateSpirv(code, size, "shader code");
+		return get(code, size, fnv1a(code, size));
+	}
+
+	std::shared_ptr<TvShaderModule> TvShaderRegistry::get(const uint32_t* code, size_t size, uint64_t hash)
+	{
+		Key key{ hash, size };
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto it = modules.find(key);
+		if (it != modules.end())
+		{
+			hits++;
+			return it->second;
+		}
+		misses++;
+		auto module = std::make_shared<TvShaderModule>(device, code, size);
+		modules.emplace(key, module);
+		return module;
+	}
+
+	uint32_t TvShaderRegistry::releaseUnused()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		uint32_t count = 0;
+		for (auto it = modules.begin(); it != modules.end();)
+		{
+			// we're the only owner, so no pipeline is being built with it right now
+			if (it->second.use_count() == 1)
+			{
+				it = modules.erase(it);
+				count++;
+			}
+			else
+			{
+				++it;
+			}
+		}
+		released += count;
+		return count;
+	}
+
+	TvShaderRegistry::Stats TvShaderRegistry::stats()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats stats;
+		stats.hits = hits;
+		stats.misses = misses;
+		stats.released = released;
+		stats.moduleCount = static_cast<uint32_t>(modules.size());
+		for (auto& entry : modules)
+		{
+			stats.codeBytes += entry.second->codeSize();
+		}
+		return stats;
+	}
+
+	void TvShaderRegistry::printStats(std::ostream& out)
+	{
+		Stats s = stats();
+		out << "shader modules: " << s.hits << " hits, " << s.misses << " misses, "
+			<< s.moduleCount << " live (" << s.codeBytes << " bytes of SPIR-V), " << s.released << " released" << std::endl;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+#include "tv_shader_bundle.hpp"
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tv
+{
+	// A VkShaderModule that destroys itself once the last pipeline holding it lets go
+	class TvShaderModule
+	{
+	public:
+		// size is in bytes
+		TvShaderModule(VkDevice device, const uint32_t* code, size_t size);
+		~TvShaderModule();
+
+		TvShaderModule(const TvShaderModule&) = delete;
+		void operator=(const TvShaderModule&) = delete;
+
+		VkShaderModule handle() const { return module; }
+		size_t codeSize() const { return size; }
+	private:
+		VkDevice device;
+		VkShaderModule module = VK_NULL_HANDLE;
+		size_t size;
+	};
+
+	// throws unless code looks like SPIR-V: whole words, a full header and the right magic number
+	// name only goes into the error message
+	void validateSpirv(const void* code, size_t size, const std::string& name);
+
+	// Every shader module on the device comes from here, so a shader used by twenty pipeline permutations is one module
+	// Modules are keyed by a hash of the SPIR-V itself, not the path, so copies of the same file share too.
+	// A module is only needed while a pipeline is being created, so pipelines hold onto theirs just for that and
+	// releaseUnused() gets rid of the ones nobody is building with anymore.
+	// Shaders come from mounted bundles when they have them and are mapped from loose files otherwise, either way
+	// the SPIR-V goes straight from the mapping to the driver.
+	// Safe to call from multiple threads.
+	class TvShaderRegistry
+	{
+	public:
+		struct Stats
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint32_t moduleCount = 0;
+			// SPIR-V bytes behind the live modules
+			size_t codeBytes = 0;
+			// modules destroyed by releaseUnused
+			uint64_t released = 0;
+		};
+
+		explicit TvShaderRegistry(VkDevice device);
+
+		TvShaderRegistry(const TvShaderRegistry&) = delete;
+		void operator=(const TvShaderRegistry&) = delete;
+
+		// load() looks in every mounted bundle (newest first) before falling back to the file system
+		void mount(std::shared_ptr<TvShaderBundle> bundle);
+		// from now on name always comes from the file system, even if a bundle has it (for shaders rebuilt while running)
+		void preferFile(const std::string& name);
+		// returns the module for a bundle stage or .spv file, creating it if we haven't seen that SPIR-V before
+		std::shared_ptr<TvShaderModule> load(const std::string& name);
+		// same thing for SPIR-V that's already in memory (size in bytes)
+		std::shared_ptr<TvShaderModule> get(const uint32_t* code, size_t size);
+		// destroys every module only the registry still holds, call once a batch of pipelines is built
+		// returns how many went
+		uint32_t releaseUnused();
+
+		Stats stats();
+		void printStats(std::ostream& out);
+	private:
+		// (hash, size), the size makes an accidental collision even less likely
+		using Key = std::pair<uint64_t, size_t>;
+
+		std::shared_ptr<TvShaderModule> get(const uint32_t* code, size_t size, uint64_t hash);
+
+		VkDevice device;
+		std::mutex mutex;
+		std::map<Key, std::shared_ptr<TvShaderModule>> modules;
+		std::vector<std::shared_ptr<TvShaderBundle>> bundles;
+		std::set<std::string> preferredFiles;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t released = 0;
+	};
+}
\ No newline at end of file
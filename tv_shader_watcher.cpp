@@ -0,0 +1,218 @@
+#include "tv_shader_watcher.hpp"
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace tv
+{
+	namespace
+	{
+		// how long things have to stay quiet before we compile, editors often write a file in a few steps
+		constexpr int SETTLE_MS = 50;
+
+		std::string shellQuote(const std::string& path)
+		{
+			return "\"" + path + "\"";
+		}
+	}
+
+	TvShaderWatcher::TvShaderWatcher(std::vector<ShaderSource> sources, std::string compiler)
+		: sources{ std::move(sources) }, compiler{ std::move(compiler) }
+	{
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyFd < 0)
+		{
+			throw std::runtime_error("failed to start watching shaders (inotify_init1)");
+		}
+		for (const ShaderSource& source : this->sources)
+		{
+			std::filesystem::path directory = std::filesystem::path{ source.glslPath }.parent_path();
+			if (directory.empty())
+			{
+				directory = ".";
+			}
+			// adding the same directory twice hands back the same descriptor
+			int watch = inotify_add_watch(inotifyFd, directory.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (watch < 0)
+			{
+				close(inotifyFd);
+				throw std::runtime_error("failed to watch " + directory.string());
+			}
+			watches.push_back(watch);
+		}
+#else
+		for (const ShaderSource& source : this->sources)
+		{
+			std::error_code error;
+			auto time = std::filesystem::last_write_time(source.glslPath, error);
+			lastWriteTimes.push_back(error ? 0 : static_cast<long long>(time.time_since_epoch().count()));
+		}
+#endif
+		thread = std::thread{ &TvShaderWatcher::watchLoop, this };
+		std::cout << "watching " << this->sources.size() << " shaders for changes (compiling with " << this->compiler << ")" << std::endl;
+	}
+
+	TvShaderWatcher::~TvShaderWatcher()
+	{
+		stopping = true;
+		thread.join();
+#ifdef __linux__
+		close(inotifyFd);
+#endif
+	}
+
+	std::string TvShaderWatcher::defaultCompiler()
+	{
+		if (const char* glslc = std::getenv("GLSLC"))
+		{
+			return glslc;
+		}
+		if (const char* sdk = std::getenv("VULKAN_SDK"))
+		{
+#ifdef _WIN32
+			std::filesystem::path glslc = std::filesystem::path{ sdk } / "Bin" / "glslc.exe";
+#else
+			std::filesystem::path glslc = std::filesystem::path{ sdk } / "bin" / "glslc";
+#endif
+			if (std::filesystem::exists(glslc))
+			{
+				return glslc.string();
+			}
+		}
+		return "glslc";
+	}
+
+	std::vector<std::string> TvShaderWatcher::takeRebuilt()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		std::vector<std::string> taken;
+		taken.swap(rebuilt);
+		return taken;
+	}
+
+	void TvShaderWatcher::watchLoop()
+	{
+		while (!stopping)
+		{
+			std::vector<size_t> changed = waitForChanges(100);
+			if (changed.empty())
+			{
+				continue;
+			}
+			// let the editor finish, anything else that changes meanwhile gets compiled in the same go
+			for (std::vector<size_t> more = waitForChanges(SETTLE_MS); !more.empty(); more = waitForChanges(SETTLE_MS))
+			{
+				changed.insert(changed.end(), more.begin(), more.end());
+			}
+
+			std::vector<bool> done(sources.size(), false);
+			for (size_t index : changed)
+			{
+				if (done[index])
+				{
+					continue;
+				}
+				done[index] = true;
+				if (compile(sources[index]))
+				{
+					std::lock_guard<std::mutex> lock{ mutex };
+					rebuilt.push_back(sources[index].spvPath);
+				}
+			}
+		}
+	}
+
+#ifdef __linux__
+	std::vector<size_t> TvShaderWatcher::waitForChanges(int timeoutMs)
+	{
+		std::vector<size_t> changed;
+		pollfd pollInfo{ inotifyFd, POLLIN, 0 };
+		if (poll(&pollInfo, 1, timeoutMs) <= 0)
+		{
+			return changed;
+		}
+
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* pointer = buffer; pointer < buffer + length;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(pointer);
+				pointer += sizeof(inotify_event) + event->len;
+				if (event->len == 0)
+				{
+					continue;
+				}
+				for (size_t i = 0; i < sources.size(); i++)
+				{
+					if (watches[i] == event->wd && std::filesystem::path{ sources[i].glslPath }.filename() == event->name)
+					{
+						changed.push_back(i);
+					}
+				}
+			}
+		}
+		return changed;
+	}
+#else
+	std::vector<size_t> TvShaderWatcher::waitForChanges(int timeoutMs)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds{ timeoutMs });
+		std::vector<size_t> changed;
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			std::error_code error;
+			auto time = std::filesystem::last_write_time(sources[i].glslPath, error);
+			long long writeTime = error ? 0 : static_cast<long long>(time.time_since_epoch().count());
+			if (writeTime != lastWriteTimes[i])
+			{
+				lastWriteTimes[i] = writeTime;
+				changed.push_back(i);
+			}
+		}
+		return changed;
+	}
+#endif
+
+	bool TvShaderWatcher::compile(const ShaderSource& source)
+	{
+		// into a temp file first, the old .spv stays put if this fails
+		std::string tempPath = source.spvPath + ".tmp";
+		std::string command = shellQuote(compiler) + " " + shellQuote(source.glslPath) + " -o " + shellQuote(tempPath);
+#ifdef _WIN32
+		// cmd strips the outer quotes off the whole line, so give it a pair to strip
+		command = "\"" + command + "\"";
+#endif
+		auto start = std::chrono::steady_clock::now();
+		if (std::system(command.c_str()) != 0)
+		{
+			std::remove(tempPath.c_str());
+			std::cerr << "failed to compile " << source.glslPath << ", keeping the old shader" << std::endl;
+			return false;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, source.spvPath, error);
+		if (error)
+		{
+			std::cerr << "failed to replace " << source.spvPath << ": " << error.message() << std::endl;
+			return false;
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "recompiled " << source.glslPath << " in " << ms << "ms" << std::endl;
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tv
+{
+	// a GLSL file and the SPIR-V it compiles to
+	struct ShaderSource
+	{
+		std::string glslPath;
+		std::string spvPath;
+	};
+
+	// Watches GLSL sources and recompiles them on its own thread when they change, so editing a shader doesn't mean a restart
+	// On linux it sleeps on inotify (watching the directories, since most editors save by replacing the file), everywhere
+	// else it checks modification times a few times a second. The compiler writes to a temp file that's renamed over the
+	// .spv only if it succeeded, so a typo never leaves a broken .spv behind (the error is printed and that's it).
+	class TvShaderWatcher
+	{
+	public:
+		// compiler is invoked as: compiler <glsl> -o <spv>
+		TvShaderWatcher(std::vector<ShaderSource> sources, std::string compiler = defaultCompiler());
+		~TvShaderWatcher();
+
+		TvShaderWatcher(const TvShaderWatcher&) = delete;
+		void operator=(const TvShaderWatcher&) = delete;
+
+		// .spv files successfully rebuilt since the last call, cheap enough to call every frame
+		std::vector<std::string> takeRebuilt();
+
+		// $GLSLC, then glslc from $VULKAN_SDK, then whatever glslc is on the PATH
+		static std::string defaultCompiler();
+	private:
+		void watchLoop();
+		// returns the sources that changed, waits at most about timeoutMs
+		std::vector<size_t> waitForChanges(int timeoutMs);
+		bool compile(const ShaderSource& source);
+
+		std::vector<ShaderSource> sources;
+		std::string compiler;
+		std::atomic<bool> stopping{ false };
+
+		std::mutex mutex;
+		std::vector<std::string> rebuilt;
+
+#ifdef __linux__
+		int inotifyFd = -1;
+		// watch descriptor per source (one per directory, shared by sources in the same one)
+		std::vector<int> watches;
+#else
+		std::vector<long long> lastWriteTimes;
+#endif
+		std::thread thread;
+	};
+}
\ No newline at end of file
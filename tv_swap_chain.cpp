@@ -1,7 +1,9 @@
 #include "tv_swap_chain.hpp"
 
 // std
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -11,14 +13,57 @@
 
 namespace tv {
 
-TvSwapChain::TvSwapChain(TvDevice &deviceRef, VkExtent2D extent)
-    : device{deviceRef}, windowExtent{extent} {
-  createSwapChain();
+namespace {
+double msSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+}  // namespace
+
+TvSwapChain::TvSwapChain(
+    TvDevice &deviceRef,
+    TvFrameTimeline &timelineRef,
+    VkExtent2D extent,
+    PresentPolicy policy,
+    bool sampledDepth)
+    : presentPolicy{policy},
+      sampledDepth{sampledDepth},
+      device{deviceRef},
+      frameTimeline{timelineRef},
+      windowExtent{extent} {
+  init();
+}
+
+TvSwapChain::TvSwapChain(
+    TvDevice &deviceRef,
+    TvFrameTimeline &timelineRef,
+    VkExtent2D extent,
+    std::shared_ptr<TvSwapChain> previous)
+    : presentPolicy{previous->presentPolicy},
+      sampledDepth{previous->sampledDepth},
+      device{deviceRef},
+      frameTimeline{timelineRef},
+      windowExtent{extent},
+      oldSwapChain{previous} {
+  init();
+}
+
+void TvSwapChain::init() {
+  if (device.isHeadless()) {
+    createOffscreenImages();
+  } else {
+    createSwapChain();
+  }
   createImageViews();
   createRenderPass();
   createDepthResources();
   createFramebuffers();
   createSyncObjects();
+
+  // frames submitted before now may still be using the old swapchain's images, framebuffers and
+  // depth buffers, so it stays alive until all of them have retired
+  if (oldSwapChain != nullptr) {
+    frameTimeline.deferUntilRetired([old = std::move(oldSwapChain)]() {});
+  }
 }
 
 TvSwapChain::~TvSwapChain() {
@@ -32,73 +77,119 @@ TvSwapChain::~TvSwapChain() {
     swapChain = nullptr;
   }
 
+  for (size_t i = 0; i < offscreenImageAllocations.size(); i++) {
+    device.destroyImage(swapChainImages[i], offscreenImageAllocations[i]);
+  }
+
   for (int i = 0; i < depthImages.size(); i++) {
     vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
     vkDestroyImage(device.device(), depthImages[i], nullptr);
-    vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
   }
+  device.allocator().free(depthImageAllocation);
 
   for (auto framebuffer : swapChainFramebuffers) {
     vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
   }
 
-  vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  // the render pass and sync objects are empty here if a newer swapchain took them over
+  if (renderPass != VK_NULL_HANDLE) {
+    vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  }
+  if (loadRenderPass != VK_NULL_HANDLE) {
+    vkDestroyRenderPass(device.device(), loadRenderPass, nullptr);
+  }
 
   // cleanup synchronization objects
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (size_t i = 0; i < imageAvailableSemaphores.size(); i++) {
     vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
     vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-    vkDestroyFence(device.device(), inFlightFences[i], nullptr);
   }
 }
 
 VkResult TvSwapChain::acquireNextImage(uint32_t *imageIndex) {
-  vkWaitForFences(
-      device.device(),
-      1,
-      &inFlightFences[currentFrame],
-      VK_TRUE,
-      std::numeric_limits<uint64_t>::max());
+  timings = SwapChainTimings{};
+  // the one blocking wait per frame: the frame that last used this frame slot has to retire
+  // before we can reuse its semaphores (and whatever else the caller keeps per frame slot)
+  auto start = std::chrono::steady_clock::now();
+  frameTimeline.waitForFrameSlot();
+  timings.frameWaitMs = msSince(start);
+  const uint32_t frameIndex = frameTimeline.frameIndex();
+
+  // offscreen images are handed out round robin, the frame slot wait above (and the image wait
+  // in submitCommandBuffers) gives the same guarantees the presentation engine would
+  if (device.isHeadless()) {
+    *imageIndex = nextOffscreenImage;
+    nextOffscreenImage = (nextOffscreenImage + 1) % static_cast<uint32_t>(imageCount());
+    return VK_SUCCESS;
+  }
 
+  start = std::chrono::steady_clock::now();
   VkResult result = vkAcquireNextImageKHR(
       device.device(),
       swapChain,
       std::numeric_limits<uint64_t>::max(),
-      imageAvailableSemaphores[currentFrame],  // must be a not signaled semaphore
+      imageAvailableSemaphores[frameIndex],  // must be a not signaled semaphore
       VK_NULL_HANDLE,
       imageIndex);
+  timings.acquireMs = msSince(start);
 
   return result;
 }
 
 VkResult TvSwapChain::submitCommandBuffers(
     const VkCommandBuffer *buffers, uint32_t *imageIndex) {
-  if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-    vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
-  }
-  imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
+  const uint32_t frameIndex = frameTimeline.frameIndex();
+  const uint64_t frame = frameTimeline.currentFrame();
+
+  // usually a no-op: the image was last rendered by a frame that has long since retired, unless
+  // there are fewer images than frames in flight or the presentation engine handed them back out of order
+  auto start = std::chrono::steady_clock::now();
+  frameTimeline.waitForFrame(imageFrames[*imageIndex]);
+  timings.imageWaitMs = msSince(start);
+  imageFrames[*imageIndex] = frame;
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+  // headless frames were never acquired from a presentation engine and are never presented,
+  // so the only thing to wait on/signal is the frame timeline
+  const uint32_t binaryCount = device.isHeadless() ? 0 : 1;
+
+  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[frameIndex]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.waitSemaphoreCount = binaryCount;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
 
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = buffers;
 
-  VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
-
-  vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
-      VK_SUCCESS) {
+  // the timeline goes last so it's at the same spot whether or not the binary semaphore is there
+  VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[frameIndex], frameTimeline.semaphore()};
+  submitInfo.signalSemaphoreCount = binaryCount + 1;
+  submitInfo.pSignalSemaphores = signalSemaphores + (1 - binaryCount);
+
+  // values for binary semaphores are ignored, but the arrays still have to line up
+  uint64_t waitValues[] = {0};
+  uint64_t signalValues[] = {0, frame};
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+  timelineInfo.signalSemaphoreValueCount = submitInfo.signalSemaphoreCount;
+  timelineInfo.pSignalSemaphoreValues = signalValues + (1 - binaryCount);
+  submitInfo.pNext = &timelineInfo;
+
+  start = std::chrono::steady_clock::now();
+  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
     throw std::runtime_error("failed to submit draw command buffer!");
   }
+  timings.submitMs = msSince(start);
+  frameTimeline.frameSubmitted();
+
+  if (device.isHeadless()) {
+    return VK_SUCCESS;
+  }
 
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -112,9 +203,9 @@ VkResult TvSwapChain::submitCommandBuffers(
 
   presentInfo.pImageIndices = imageIndex;
 
+  start = std::chrono::steady_clock::now();
   auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
-
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  timings.presentMs = msSince(start);
 
   return result;
 }
@@ -123,10 +214,14 @@ void TvSwapChain::createSwapChain() {
   SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
   VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-  VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+  presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
   VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  // the extra image keeps us from stalling on the presentation engine, power saving would rather stall
+  uint32_t imageCount = swapChainSupport.capabilities.minImageCount;
+  if (presentPolicy != PresentPolicy::PowerSaving) {
+    imageCount++;
+  }
   if (swapChainSupport.capabilities.maxImageCount > 0 &&
       imageCount > swapChainSupport.capabilities.maxImageCount) {
     imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -162,7 +257,9 @@ void TvSwapChain::createSwapChain() {
   createInfo.presentMode = presentMode;
   createInfo.clipped = VK_TRUE;
 
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
+  // handing over the old swapchain lets the driver reuse its resources and keeps presenting
+  // whatever it has queued, it's retired (can't acquire from it anymore) after this
+  createInfo.oldSwapchain = oldSwapChain == nullptr ? VK_NULL_HANDLE : oldSwapChain->swapChain;
 
   if (vkCreateSwapchainKHR(device.device(), &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
     throw std::runtime_error("failed to create swap chain!");
@@ -180,6 +277,44 @@ void TvSwapChain::createSwapChain() {
   swapChainExtent = extent;
 }
 
+void TvSwapChain::createOffscreenImages() {
+  VkFormat format = device.findSupportedFormat(
+      {VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM},
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+
+  swapChainImages.resize(HEADLESS_IMAGE_COUNT);
+  offscreenImageAllocations.resize(HEADLESS_IMAGE_COUNT);
+
+  for (uint32_t i = 0; i < HEADLESS_IMAGE_COUNT; i++) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = windowExtent.width;
+    imageInfo.extent.height = windowExtent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // transfer src so frames can be read back, same as a swapchain image could be
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.flags = 0;
+
+    device.createImageWithInfo(
+        imageInfo,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        swapChainImages[i],
+        offscreenImageAllocations[i]);
+  }
+
+  swapChainImageFormat = format;
+  swapChainExtent = windowExtent;
+}
+
 void TvSwapChain::createImageViews() {
   swapChainImageViews.resize(swapChainImages.size());
   for (size_t i = 0; i < swapChainImages.size(); i++) {
@@ -202,15 +337,31 @@ void TvSwapChain::createImageViews() {
 }
 
 void TvSwapChain::createRenderPass() {
+  swapChainDepthFormat = findDepthFormat();
+
+  // the render pass only depends on the formats, not the extent, so a resize can keep using it
+  // (and so can every pipeline built against it)
+  if (oldSwapChain != nullptr && oldSwapChain->renderPass != VK_NULL_HANDLE &&
+      oldSwapChain->swapChainImageFormat == swapChainImageFormat &&
+      oldSwapChain->swapChainDepthFormat == swapChainDepthFormat) {
+    renderPass = oldSwapChain->renderPass;
+    oldSwapChain->renderPass = VK_NULL_HANDLE;
+    loadRenderPass = oldSwapChain->loadRenderPass;
+    oldSwapChain->loadRenderPass = VK_NULL_HANDLE;
+    return;
+  }
+
   VkAttachmentDescription depthAttachment{};
-  depthAttachment.format = findDepthFormat();
+  depthAttachment.format = swapChainDepthFormat;
   depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
   depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.storeOp =
+      sampledDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
   depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  depthAttachment.finalLayout = sampledDepth ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                             : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference depthAttachmentRef{};
   depthAttachmentRef.attachment = 1;
@@ -224,7 +375,9 @@ void TvSwapChain::createRenderPass() {
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // PRESENT_SRC_KHR needs VK_KHR_swapchain, offscreen images end up ready to be copied out instead
+  colorAttachment.finalLayout = device.isHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                    : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
   VkAttachmentReference colorAttachmentRef = {};
   colorAttachmentRef.attachment = 0;
@@ -238,15 +391,34 @@ void TvSwapChain::createRenderPass() {
 
   VkSubpassDependency dependency = {};
   dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.srcAccessMask = 0;
-  dependency.srcStageMask =
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  // depth images are shared between frames, so the last frame's depth writes have to finish
+  // before this one clears it
+  dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
   dependency.dstSubpass = 0;
   dependency.dstStageMask =
       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
   dependency.dstAccessMask =
       VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+  // a sampled depth attachment is read by compute between frames (and between the two passes of
+  // one frame), so the clear also waits for those reads, and the depth writes are made visible
+  // to compute once the pass ends
+  VkSubpassDependency readDependency = {};
+  readDependency.srcSubpass = 0;
+  readDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+  readDependency.srcStageMask =
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  readDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  readDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  readDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  if (sampledDepth) {
+    dependency.srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  }
+
+  std::array<VkSubpassDependency, 2> dependencies = {dependency, readDependency};
   std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
   VkRenderPassCreateInfo renderPassInfo = {};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -254,18 +426,51 @@ void TvSwapChain::createRenderPass() {
   renderPassInfo.pAttachments = attachments.data();
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpass;
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependency;
+  renderPassInfo.dependencyCount = sampledDepth ? 2 : 1;
+  renderPassInfo.pDependencies = dependencies.data();
 
   if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
     throw std::runtime_error("failed to create render pass!");
   }
+
+  if (!sampledDepth) {
+    return;
+  }
+
+  // the load pass picks up where the first one left off: both attachments come in with what the
+  // first pass stored, in the layouts it left them in
+  attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  attachments[0].initialLayout = colorAttachment.finalLayout;
+  attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  attachments[1].initialLayout = depthAttachment.finalLayout;
+
+  // the first pass's color and depth writes (and compute's depth reads) have to be done before
+  // this one loads and writes the attachments again
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  dependencies[0].srcAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &loadRenderPass) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create load render pass!");
+  }
 }
 
 void TvSwapChain::createFramebuffers() {
-  swapChainFramebuffers.resize(imageCount());
-  for (size_t i = 0; i < imageCount(); i++) {
-    std::array<VkImageView, 2> attachments = {swapChainImageViews[i], depthImageViews[i]};
+  swapChainFramebuffers.resize(imageCount() * depthImages.size());
+  for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
+    std::array<VkImageView, 2> attachments = {
+        swapChainImageViews[i / depthImages.size()],
+        depthImageViews[i % depthImages.size()]};
 
     VkExtent2D swapChainExtent = getSwapChainExtent();
     VkFramebufferCreateInfo framebufferInfo = {};
@@ -291,32 +496,71 @@ void TvSwapChain::createDepthResources() {
   VkFormat depthFormat = findDepthFormat();
   VkExtent2D swapChainExtent = getSwapChainExtent();
 
-  depthImages.resize(imageCount());
-  depthImageMemorys.resize(imageCount());
-  depthImageViews.resize(imageCount());
+  const uint32_t depthCount = frameTimeline.framesInFlight();
+  depthImages.resize(depthCount);
+  depthImageViews.resize(depthCount);
+
+  // never read after the render pass (load CLEAR, store DONT_CARE) unless it's sampled, so it can
+  // usually be transient
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = swapChainExtent.width;
+  imageInfo.extent.height = swapChainExtent.height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = depthFormat;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                    (sampledDepth ? VK_IMAGE_USAGE_SAMPLED_BIT
+                                  : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.flags = 0;
+
+  // all the images are identical, so they get the same requirements and sit back to back in one allocation
+  VkMemoryRequirements memRequirements{};
+  for (uint32_t i = 0; i < depthCount; i++) {
+    if (vkCreateImage(device.device(), &imageInfo, nullptr, &depthImages[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth image!");
+    }
+  }
+  vkGetImageMemoryRequirements(device.device(), depthImages[0], &memRequirements);
+  VkDeviceSize stride = (memRequirements.size + memRequirements.alignment - 1) /
+                        memRequirements.alignment * memRequirements.alignment;
+
+  // lazily allocated memory only gets backed if the gpu actually needs to spill the attachment
+  // (desktop gpus usually don't have any, then it's plain device local)
+  uint32_t memoryType;
+  VkMemoryPropertyFlags properties =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+  depthStats.sampled = sampledDepth;
+  depthStats.lazilyAllocated =
+      !sampledDepth &&
+      device.tryFindMemoryType(memRequirements.memoryTypeBits, properties, memoryType);
+  if (!depthStats.lazilyAllocated) {
+    properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  }
 
-  for (int i = 0; i < depthImages.size(); i++) {
-    VkImageCreateInfo imageInfo{};
-    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = swapChainExtent.width;
-    imageInfo.extent.height = swapChainExtent.height;
-    imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = depthFormat;
-    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    imageInfo.flags = 0;
+  VkMemoryRequirements allRequirements = memRequirements;
+  allRequirements.size = stride * depthCount;
+  depthImageAllocation = device.allocator().allocate(
+      allRequirements, properties, TvAllocator::ResourceKind::Optimal);
 
-    device.createImageWithInfo(
-        imageInfo,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        depthImages[i],
-        depthImageMemorys[i]);
+  depthStats.imageCount = depthCount;
+  depthStats.bytes = allRequirements.size;
+  depthStats.perSwapChainImageBytes = stride * imageCount();
+
+  for (uint32_t i = 0; i < depthCount; i++) {
+    if (vkBindImageMemory(
+            device.device(),
+            depthImages[i],
+            depthImageAllocation.memory,
+            depthImageAllocation.offset + stride * i) != VK_SUCCESS) {
+      throw std::runtime_error("failed to bind depth image memory!");
+    }
 
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -336,24 +580,29 @@ void TvSwapChain::createDepthResources() {
 }
 
 void TvSwapChain::createSyncObjects() {
-  imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+  imageFrames.resize(imageCount(), 0);
+
+  // the per frame slot semaphores may still be waited on by frames in flight on the old
+  // swapchain, so take them over instead of starting from scratch (the frame timeline itself
+  // lives outside the swapchain and just keeps counting)
+  if (oldSwapChain != nullptr) {
+    imageAvailableSemaphores.swap(oldSwapChain->imageAvailableSemaphores);
+    renderFinishedSemaphores.swap(oldSwapChain->renderFinishedSemaphores);
+    return;
+  }
+
+  const uint32_t framesInFlight = frameTimeline.framesInFlight();
+  imageAvailableSemaphores.resize(framesInFlight);
+  renderFinishedSemaphores.resize(framesInFlight);
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (size_t i = 0; i < framesInFlight; i++) {
     if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) !=
             VK_SUCCESS ||
         vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
-            VK_SUCCESS ||
-        vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+            VK_SUCCESS) {
       throw std::runtime_error("failed to create synchronization objects for a frame!");
     }
   }
@@ -373,22 +622,41 @@ VkSurfaceFormatKHR TvSwapChain::chooseSwapSurfaceFormat(
 
 VkPresentModeKHR TvSwapChain::chooseSwapPresentMode(
     const std::vector<VkPresentModeKHR> &availablePresentModes) {
-  for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      std::cout << "Present mode: Mailbox" << std::endl;
-      return availablePresentMode;
+  for (VkPresentModeKHR preferred : presentModeOrder(presentPolicy)) {
+    if (std::find(availablePresentModes.begin(), availablePresentModes.end(), preferred) !=
+        availablePresentModes.end()) {
+      return preferred;
     }
   }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
 
-  // for (const auto &availablePresentMode : availablePresentModes) {
-  //   if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-  //     std::cout << "Present mode: Immediate" << std::endl;
-  //     return availablePresentMode;
-  //   }
-  // }
+std::vector<VkPresentModeKHR> TvSwapChain::presentModeOrder(PresentPolicy policy) {
+  switch (policy) {
+    case PresentPolicy::LowLatency:
+      return {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    case PresentPolicy::Relaxed:
+      return {VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    case PresentPolicy::PowerSaving:
+    case PresentPolicy::Vsync:
+    default:
+      return {VK_PRESENT_MODE_FIFO_KHR};
+  }
+}
 
-  std::cout << "Present mode: V-Sync" << std::endl;
-  return VK_PRESENT_MODE_FIFO_KHR;
+const char *TvSwapChain::presentModeName(VkPresentModeKHR mode) {
+  switch (mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "fifo relaxed";
+    default:
+      return "unknown";
+  }
 }
 
 VkExtent2D TvSwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
@@ -411,7 +679,8 @@ VkFormat TvSwapChain::findDepthFormat() {
   return device.findSupportedFormat(
       {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
       VK_IMAGE_TILING_OPTIMAL,
-      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+          (sampledDepth ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0));
 }
 
-}  // namespace lve
+}  // namespace lve
\ No newline at end of file
@@ -1,32 +1,106 @@
 #pragma once
 
 #include "tv_device.hpp"
+#include "tv_frame_timeline.hpp"
 
 // vulkan headers
 #include <vulkan/vulkan.h>
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace tv {
 
+// what to optimize the present mode for, each one has a fixed fallback order (see presentModeOrder)
+enum class PresentPolicy {
+  LowLatency,   // mailbox, immediate, fifo: newest frame goes out asap (pair with a frame limiter)
+  PowerSaving,  // fifo with as few images as the surface allows: never renders ahead of the display
+  Vsync,        // fifo with one extra image: never tears, never drops a frame
+  Relaxed,      // fifo relaxed, fifo: vsync when we keep up, tears instead of stuttering when we're late
+};
+
+// what the depth attachments cost, for the startup report
+struct DepthMemoryStats {
+  uint32_t imageCount = 0;
+  VkDeviceSize bytes = 0;
+  // what one depth image per swapchain image (the old way) would have needed
+  VkDeviceSize perSwapChainImageBytes = 0;
+  // lazily allocated memory may never actually get backed (tile based gpus keep depth on chip)
+  bool lazilyAllocated = false;
+  // kept after the render pass so compute can read it, can't be transient then
+  bool sampled = false;
+};
+
+// cpu time (ms) spent in each blocking part of the last acquire/submit/present
+struct SwapChainTimings {
+  double frameWaitMs = 0.0;
+  double acquireMs = 0.0;
+  double imageWaitMs = 0.0;
+  double submitMs = 0.0;
+  double presentMs = 0.0;
+};
+
 class TvSwapChain {
  public:
-  static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-  TvSwapChain(TvDevice &deviceRef, VkExtent2D windowExtent);
+  // number of offscreen images we rotate through when there is no window to present to
+  static constexpr uint32_t HEADLESS_IMAGE_COUNT = 3;
+
+  // frames are paced by (and signal) the frame timeline, which outlives any one swapchain.
+  // sampledDepth keeps the depth attachments around after the render pass (stored, and left in
+  // SHADER_READ_ONLY_OPTIMAL) so compute shaders can read them, see getLoadRenderPass
+  TvSwapChain(
+      TvDevice &deviceRef,
+      TvFrameTimeline &timelineRef,
+      VkExtent2D windowExtent,
+      PresentPolicy policy = PresentPolicy::LowLatency,
+      bool sampledDepth = false);
+  // recreates the swapchain (resize/out of date) by retiring `previous` through oldSwapchain.
+  // the render pass and semaphores are handed over, and `previous` is kept alive until every
+  // frame that was in flight on it has retired, so nothing needs a vkDeviceWaitIdle.
+  // keeps the previous swapchain's present policy and depth usage
+  TvSwapChain(
+      TvDevice &deviceRef,
+      TvFrameTimeline &timelineRef,
+      VkExtent2D windowExtent,
+      std::shared_ptr<TvSwapChain> previous);
   ~TvSwapChain();
 
   TvSwapChain(const TvSwapChain &) = delete;
   void operator=(const TvSwapChain &) = delete;
 
-  VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
+  // one framebuffer per swapchain image per depth image, the depth image goes with the frame index
+  VkFramebuffer getFrameBuffer(uint32_t imageIndex, uint32_t frameIndex) {
+    return swapChainFramebuffers[imageIndex * depthImages.size() + frameIndex % depthImages.size()];
+  }
   VkRenderPass getRenderPass() { return renderPass; }
+  // same attachments as getRenderPass but loaded instead of cleared, for going on drawing into a
+  // frame after something outside the render pass (compute) has read its depth. compatible with
+  // the same framebuffers and pipelines. only with sampled depth, VK_NULL_HANDLE otherwise
+  VkRenderPass getLoadRenderPass() { return loadRenderPass; }
+  bool isDepthSampled() const { return sampledDepth; }
+  // the depth attachment that goes with a frame index (same one getFrameBuffer uses)
+  VkImageView getDepthImageView(uint32_t frameIndex) {
+    return depthImageViews[frameIndex % depthImageViews.size()];
+  }
+  size_t depthImageCount() { return depthImages.size(); }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
+  PresentPolicy getPresentPolicy() const { return presentPolicy; }
+  // the mode we ended up with after the fallbacks (FIFO when headless, nothing is presented)
+  VkPresentModeKHR getPresentMode() const { return presentMode; }
+  // true if presenting never blocks, so nothing but a frame limiter keeps the cpu from running flat out
+  bool isPresentUnthrottled() const {
+    return presentMode == VK_PRESENT_MODE_MAILBOX_KHR || presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR;
+  }
+
+  // preferred present modes for a policy, best first. fifo is always last since it's the only one
+  // that's guaranteed to be supported
+  static std::vector<VkPresentModeKHR> presentModeOrder(PresentPolicy policy);
+  static const char *presentModeName(VkPresentModeKHR mode);
   uint32_t width() { return swapChainExtent.width; }
   uint32_t height() { return swapChainExtent.height; }
 
@@ -37,9 +111,13 @@ class TvSwapChain {
 
   VkResult acquireNextImage(uint32_t *imageIndex);
   VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+  const SwapChainTimings &lastTimings() const { return timings; }
+  const DepthMemoryStats &depthMemoryStats() const { return depthStats; }
 
  private:
+  void init();
   void createSwapChain();
+  void createOffscreenImages();
   void createImageViews();
   void createDepthResources();
   void createRenderPass();
@@ -54,27 +132,42 @@ class TvSwapChain {
   VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
 
   VkFormat swapChainImageFormat;
+  VkFormat swapChainDepthFormat;
   VkExtent2D swapChainExtent;
+  PresentPolicy presentPolicy;
+  bool sampledDepth;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
 
   std::vector<VkFramebuffer> swapChainFramebuffers;
-  VkRenderPass renderPass;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkRenderPass loadRenderPass = VK_NULL_HANDLE;
 
+  // depth is only needed while a frame is rendering, so there's one per frame in flight (not per
+  // swapchain image), all sharing one allocation (and transient unless it's sampled)
   std::vector<VkImage> depthImages;
-  std::vector<VkDeviceMemory> depthImageMemorys;
+  TvAllocation depthImageAllocation;
   std::vector<VkImageView> depthImageViews;
+  DepthMemoryStats depthStats;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
+  // only used in headless mode, real swapchain images are owned by the swapchain
+  std::vector<TvAllocation> offscreenImageAllocations;
+  uint32_t nextOffscreenImage = 0;
 
   TvDevice &device;
+  TvFrameTimeline &frameTimeline;
   VkExtent2D windowExtent;
 
-  VkSwapchainKHR swapChain;
+  VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+  // only set while init() hands things over, then deferred until its frames retire
+  std::shared_ptr<TvSwapChain> oldSwapChain;
 
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
-  std::vector<VkFence> imagesInFlight;
-  size_t currentFrame = 0;
+  // the frame (timeline value) that last rendered to each image, 0 if none has
+  std::vector<uint64_t> imageFrames;
+
+  SwapChainTimings timings;
 };
 
-}  // namespace lve
+}  // namespace lve
\ No newline at end of file
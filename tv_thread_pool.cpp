@@ -0,0 +1,101 @@
+#include "tv_thread_pool.hpp"
+
+namespace tv
+{
+	TvThreadPool::TvThreadPool(uint32_t threadCount)
+	{
+		workers.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			workers.emplace_back(&TvThreadPool::workerLoop, this, i);
+		}
+	}
+
+	TvThreadPool::~TvThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		workReady.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	void TvThreadPool::parallelFor(uint32_t taskCount, const Task& fn)
+	{
+		if (taskCount == 0)
+		{
+			return;
+		}
+		// nobody to hand it to, so the caller gets to be worker 0
+		if (workers.empty())
+		{
+			for (uint32_t task = 0; task < taskCount; task++)
+			{
+				fn(task, 0);
+			}
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock{ mutex };
+		batchFn = &fn;
+		batchSize = taskCount;
+		nextTask = 0;
+		tasksLeft = taskCount;
+		batchError = nullptr;
+		batchId++;
+		workReady.notify_all();
+
+		workDone.wait(lock, [this]() { return tasksLeft == 0; });
+		batchFn = nullptr;
+		if (batchError)
+		{
+			std::rethrow_exception(batchError);
+		}
+	}
+
+	void TvThreadPool::workerLoop(uint32_t workerIndex)
+	{
+		uint64_t seenBatch = 0;
+		std::unique_lock<std::mutex> lock{ mutex };
+		while (true)
+		{
+			workReady.wait(lock, [&]() { return stopping || batchId != seenBatch; });
+			if (stopping)
+			{
+				return;
+			}
+			seenBatch = batchId;
+
+			// grab tasks until the batch runs dry, the lock is only held while picking the next one
+			while (nextTask < batchSize)
+			{
+				uint32_t task = nextTask++;
+				const Task& fn = *batchFn;
+				lock.unlock();
+				try
+				{
+					fn(task, workerIndex);
+				}
+				catch (...)
+				{
+					lock.lock();
+					if (!batchError)
+					{
+						batchError = std::current_exception();
+					}
+					lock.unlock();
+				}
+				lock.lock();
+
+				if (--tasksLeft == 0)
+				{
+					workDone.notify_one();
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tv
+{
+	// A handful of long lived worker threads for splitting up per-frame cpu work (command recording for now)
+	// Work goes out as a batch of numbered tasks and the caller blocks until the whole batch is done,
+	// every task also gets told which worker runs it so it can use that worker's own stuff (like its command pool)
+	class TvThreadPool
+	{
+	public:
+		// fn(taskIndex, workerIndex)
+		using Task = std::function<void(uint32_t, uint32_t)>;
+
+		explicit TvThreadPool(uint32_t threadCount);
+		~TvThreadPool();
+
+		TvThreadPool(const TvThreadPool&) = delete;
+		void operator=(const TvThreadPool&) = delete;
+
+		uint32_t size() const { return static_cast<uint32_t>(workers.size()); }
+
+		// runs fn for every task index in [0, taskCount) across the workers and waits for all of them,
+		// the first exception a task throws gets rethrown here once the batch is done (with no threads it all runs on the caller as worker 0)
+		void parallelFor(uint32_t taskCount, const Task& fn);
+	private:
+		void workerLoop(uint32_t workerIndex);
+
+		std::vector<std::thread> workers;
+
+		std::mutex mutex;
+		std::condition_variable workReady;
+		std::condition_variable workDone;
+		// the current batch, bumping batchId is what wakes the workers
+		const Task* batchFn = nullptr;
+		uint32_t batchSize = 0;
+		uint32_t nextTask = 0;
+		uint32_t tasksLeft = 0;
+		uint64_t batchId = 0;
+		std::exception_ptr batchError;
+		bool stopping = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,439 @@
+#include "tv_upload_manager.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace tv
+{
+	namespace
+	{
+		uint64_t alignUp(uint64_t value, uint64_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		VkSemaphore createTimelineSemaphore(VkDevice device)
+		{
+			VkSemaphoreTypeCreateInfo typeInfo{};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			typeInfo.initialValue = 0;
+
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			semaphoreInfo.pNext = &typeInfo;
+
+			VkSemaphore semaphore;
+			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create upload timeline semaphore");
+			}
+			return semaphore;
+		}
+
+		VkCommandPool createPool(VkDevice device, uint32_t family)
+		{
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.queueFamilyIndex = family;
+			// command buffers get recycled one at a time as their batches retire
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+			VkCommandPool pool;
+			if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create upload command pool");
+			}
+			return pool;
+		}
+	}
+
+	TvUploadManager::TvUploadManager(TvDevice& device, VkDeviceSize stagingSize) : tvDevice{ device }, stagingSize{ stagingSize }
+	{
+		QueueFamilyIndices indices = tvDevice.findPhysicalQueueFamilies();
+		transferFamily = indices.transferFamily;
+		graphicsFamily = indices.graphicsFamily;
+		separateTransferQueue = transferFamily != graphicsFamily;
+		copyAlignment = std::max<VkDeviceSize>(copyAlignment, tvDevice.properties.limits.optimalBufferCopyOffsetAlignment);
+
+		// host coherent so there's no flushing, the submit makes our writes visible to the copies
+		tvDevice.createBuffer(
+			stagingSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer,
+			stagingAllocation);
+		if (stagingAllocation.mapped == nullptr)
+		{
+			throw std::runtime_error("upload staging buffer isn't mapped");
+		}
+
+		transferPool = createPool(tvDevice.device(), transferFamily);
+		doneSemaphore = createTimelineSemaphore(tvDevice.device());
+		if (separateTransferQueue)
+		{
+			graphicsPool = createPool(tvDevice.device(), graphicsFamily);
+			copySemaphore = createTimelineSemaphore(tvDevice.device());
+		}
+	}
+
+	TvUploadManager::~TvUploadManager()
+	{
+		wait(flush());
+		collectRetired();
+
+		vkDestroyCommandPool(tvDevice.device(), transferPool, nullptr);
+		vkDestroySemaphore(tvDevice.device(), doneSemaphore, nullptr);
+		if (separateTransferQueue)
+		{
+			vkDestroyCommandPool(tvDevice.device(), graphicsPool, nullptr);
+			vkDestroySemaphore(tvDevice.device(), copySemaphore, nullptr);
+		}
+		tvDevice.destroyBuffer(stagingBuffer, stagingAllocation);
+	}
+
+	void TvUploadManager::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+	{
+		// half the ring at a time, so a chunk always fits once the ring drains (even after wrapping)
+		const VkDeviceSize maxChunk = stagingSize / 2;
+		const char* src = static_cast<const char*>(data);
+		for (VkDeviceSize done = 0; done < size; )
+		{
+			VkDeviceSize chunk = std::min(size - done, maxChunk);
+			// reserve before touching the batch, making room might flush it
+			VkDeviceSize stagingOffset = reserveStaging(chunk, copyAlignment);
+			std::memcpy(static_cast<char*>(stagingAllocation.mapped) + stagingOffset, src + done, static_cast<size_t>(chunk));
+
+			Batch& batch = currentBatch();
+			VkBufferCopy region{};
+			region.srcOffset = stagingOffset;
+			region.dstOffset = dstOffset + done;
+			region.size = chunk;
+			vkCmdCopyBuffer(batch.transferCommands, stagingBuffer, dst, 1, &region);
+
+			VkBufferMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = separateTransferQueue ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = separateTransferQueue ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = dst;
+			barrier.offset = region.dstOffset;
+			barrier.size = chunk;
+			batch.bufferBarriers.push_back(barrier);
+
+			done += chunk;
+		}
+	}
+
+	void TvUploadManager::uploadImage(
+		VkImage dst,
+		VkExtent3D extent,
+		uint32_t layerCount,
+		const void* data,
+		VkDeviceSize size,
+		VkImageLayout finalLayout)
+	{
+		if (size > stagingSize / 2)
+		{
+			throw std::runtime_error("image is too big for the upload staging ring");
+		}
+		VkDeviceSize stagingOffset = reserveStaging(size, copyAlignment);
+		std::memcpy(static_cast<char*>(stagingAllocation.mapped) + stagingOffset, data, static_cast<size_t>(size));
+
+		Batch& batch = currentBatch();
+		VkImageSubresourceRange range{};
+		range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		range.baseMipLevel = 0;
+		range.levelCount = 1;
+		range.baseArrayLayer = 0;
+		range.layerCount = layerCount;
+
+		// whatever was in there gets replaced, so the old contents (and layout) don't matter
+		VkImageMemoryBarrier toTransfer{};
+		toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		toTransfer.srcAccessMask = 0;
+		toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.image = dst;
+		toTransfer.subresourceRange = range;
+		vkCmdPipelineBarrier(
+			batch.transferCommands,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = stagingOffset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = layerCount;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = extent;
+		vkCmdCopyBufferToImage(batch.transferCommands, stagingBuffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = finalLayout;
+		barrier.srcQueueFamilyIndex = separateTransferQueue ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = separateTransferQueue ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = dst;
+		barrier.subresourceRange = range;
+		batch.imageBarriers.push_back(barrier);
+	}
+
+	TvUploadManager::Token TvUploadManager::flush()
+	{
+		if (!recording)
+		{
+			return lastFlushed();
+		}
+		Batch& batch = recordingBatch;
+
+		// everything in the batch gets made available in one go. with a separate transfer queue that's a queue family
+		// release here and the matching acquire on the graphics queue, otherwise it's a plain barrier. either way the
+		// graphics queue barrier covers every later submission on it, so nothing that draws has to know about uploads
+		for (auto& barrier : batch.bufferBarriers)
+		{
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = separateTransferQueue ? 0 : VK_ACCESS_MEMORY_READ_BIT;
+		}
+		for (auto& barrier : batch.imageBarriers)
+		{
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = separateTransferQueue ? 0 : VK_ACCESS_MEMORY_READ_BIT;
+		}
+		vkCmdPipelineBarrier(
+			batch.transferCommands,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			separateTransferQueue ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+			static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+		if (vkEndCommandBuffer(batch.transferCommands) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record upload commands");
+		}
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &batch.token;
+
+		VkSemaphore copyDone = separateTransferQueue ? copySemaphore : doneSemaphore;
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.transferCommands;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &copyDone;
+		if (vkQueueSubmit(tvDevice.transferQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit uploads");
+		}
+
+		if (separateTransferQueue)
+		{
+			batch.acquireCommands = takeCommandBuffer(graphicsPool, freeGraphicsCommands);
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			if (vkBeginCommandBuffer(batch.acquireCommands, &beginInfo) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to begin upload acquire commands");
+			}
+
+			for (auto& barrier : batch.bufferBarriers)
+			{
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			}
+			for (auto& barrier : batch.imageBarriers)
+			{
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			}
+			vkCmdPipelineBarrier(
+				batch.acquireCommands,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				0, nullptr,
+				static_cast<uint32_t>(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+				static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+			if (vkEndCommandBuffer(batch.acquireCommands) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to record upload acquire commands");
+			}
+
+			// the gpu waits for the copies here, the cpu doesn't
+			VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			VkTimelineSemaphoreSubmitInfo acquireTimelineInfo{};
+			acquireTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			acquireTimelineInfo.waitSemaphoreValueCount = 1;
+			acquireTimelineInfo.pWaitSemaphoreValues = &batch.token;
+			acquireTimelineInfo.signalSemaphoreValueCount = 1;
+			acquireTimelineInfo.pSignalSemaphoreValues = &batch.token;
+
+			VkSubmitInfo acquireInfo{};
+			acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			acquireInfo.pNext = &acquireTimelineInfo;
+			acquireInfo.waitSemaphoreCount = 1;
+			acquireInfo.pWaitSemaphores = &copySemaphore;
+			acquireInfo.pWaitDstStageMask = &waitStage;
+			acquireInfo.commandBufferCount = 1;
+			acquireInfo.pCommandBuffers = &batch.acquireCommands;
+			acquireInfo.signalSemaphoreCount = 1;
+			acquireInfo.pSignalSemaphores = &doneSemaphore;
+			if (vkQueueSubmit(tvDevice.graphicsQueue(), 1, &acquireInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit upload acquire");
+			}
+		}
+
+		batch.ringEnd = ringHead;
+		batch.bufferBarriers.clear();
+		batch.imageBarriers.clear();
+		inFlight.push_back(batch);
+		recording = false;
+		nextToken++;
+		return batch.token;
+	}
+
+	bool TvUploadManager::isComplete(Token token)
+	{
+		if (token <= completed)
+		{
+			return true;
+		}
+		uint64_t value = 0;
+		if (vkGetSemaphoreCounterValue(tvDevice.device(), doneSemaphore, &value) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to read upload timeline value");
+		}
+		completed = std::max(completed, value);
+		return token <= completed;
+	}
+
+	void TvUploadManager::wait(Token token)
+	{
+		if (isComplete(token))
+		{
+			return;
+		}
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &doneSemaphore;
+		waitInfo.pValues = &token;
+		if (vkWaitSemaphores(tvDevice.device(), &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to wait for uploads");
+		}
+		completed = std::max(completed, token);
+	}
+
+	VkDeviceSize TvUploadManager::reserveStaging(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		while (true)
+		{
+			uint64_t start = alignUp(ringHead, alignment);
+			// never straddle the end of the buffer, skip to the start instead
+			if (start % stagingSize + size > stagingSize)
+			{
+				start = alignUp(start + 1, stagingSize);
+			}
+			if (start + size - ringTail <= stagingSize)
+			{
+				ringHead = start + size;
+				return static_cast<VkDeviceSize>(start % stagingSize);
+			}
+
+			// full, make room by waiting for the oldest batch (which might have to be the one we're filling)
+			collectRetired();
+			if (inFlight.empty())
+			{
+				if (!recording)
+				{
+					throw std::runtime_error("upload doesn't fit in the staging ring");
+				}
+				flush();
+			}
+			wait(inFlight.front().token);
+			collectRetired();
+		}
+	}
+
+	TvUploadManager::Batch& TvUploadManager::currentBatch()
+	{
+		if (recording)
+		{
+			return recordingBatch;
+		}
+
+		collectRetired();
+		recordingBatch = Batch{};
+		recordingBatch.token = nextToken;
+		recordingBatch.transferCommands = takeCommandBuffer(transferPool, freeTransferCommands);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(recordingBatch.transferCommands, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin upload commands");
+		}
+		recording = true;
+		return recordingBatch;
+	}
+
+	void TvUploadManager::collectRetired()
+	{
+		while (!inFlight.empty() && isComplete(inFlight.front().token))
+		{
+			Batch& batch = inFlight.front();
+			ringTail = batch.ringEnd;
+			freeTransferCommands.push_back(batch.transferCommands);
+			if (batch.acquireCommands != VK_NULL_HANDLE)
+			{
+				freeGraphicsCommands.push_back(batch.acquireCommands);
+			}
+			inFlight.pop_front();
+		}
+	}
+
+	VkCommandBuffer TvUploadManager::takeCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer>& freeList)
+	{
+		// recycled ones get reset implicitly by vkBeginCommandBuffer (the pool has RESET_COMMAND_BUFFER_BIT)
+		if (!freeList.empty())
+		{
+			VkCommandBuffer commandBuffer = freeList.back();
+			freeList.pop_back();
+			return commandBuffer;
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = pool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(tvDevice.device(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload command buffer");
+		}
+		return commandBuffer;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+#include "tv_device.hpp"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace tv
+{
+	// Gets data into device local buffers/images without stalling anybody
+	// Uploads get copied into a persistently mapped staging ring right away and the copies are batched up until flush(),
+	// which submits them all at once (on the transfer only queue if the device has one) and hands back a token instead of waiting.
+	// The token is a value on a timeline semaphore: check it, wait on it, or have a gpu submission wait on it.
+	// Only meant to be used from one thread.
+	class TvUploadManager
+	{
+	public:
+		using Token = uint64_t;
+		static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 32ull * 1024 * 1024;
+
+		TvUploadManager(TvDevice& device, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+		// waits for everything that was flushed
+		~TvUploadManager();
+
+		TvUploadManager(const TvUploadManager&) = delete;
+		void operator=(const TvUploadManager&) = delete;
+
+		// copies size bytes of data into dst at dstOffset, the data is copied out of `data` before this returns
+		// big buffers get split into chunks, so they might flush (and wait on) earlier batches to make room
+		// (the destination shouldn't be in use by the gpu, uploads replace what's there instead of syncing with readers)
+		void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+		// fills mip 0 of every layer from tightly packed texels and leaves the image in finalLayout, has to fit in half the staging ring
+		void uploadImage(
+			VkImage dst,
+			VkExtent3D extent,
+			uint32_t layerCount,
+			const void* data,
+			VkDeviceSize size,
+			VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		// submits everything uploaded since the last flush, once the token completes the data is there for the graphics queue
+		// (0 if there was nothing to submit and nothing ever was)
+		Token flush();
+		bool isComplete(Token token);
+		void wait(Token token);
+
+		// signaled with each flush's token once its uploads are done, for submissions that want to wait on the gpu instead
+		VkSemaphore semaphore() const { return doneSemaphore; }
+		Token lastFlushed() const { return nextToken - 1; }
+	private:
+		struct Batch
+		{
+			Token token = 0;
+			VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+			// queue family ownership acquires on the graphics queue, only with a separate transfer queue
+			VkCommandBuffer acquireCommands = VK_NULL_HANDLE;
+			// where the staging ring's tail moves to once this batch is done
+			uint64_t ringEnd = 0;
+			// recorded at flush, after all the copies: queue family release/acquire (or plain visibility) and final image layouts
+			std::vector<VkBufferMemoryBarrier> bufferBarriers;
+			std::vector<VkImageMemoryBarrier> imageBarriers;
+		};
+
+		// room for size bytes in the staging ring, flushes/waits if it's full, returns the offset into the staging buffer
+		VkDeviceSize reserveStaging(VkDeviceSize size, VkDeviceSize alignment);
+		// the batch being filled, started on demand
+		Batch& currentBatch();
+		void collectRetired();
+		VkCommandBuffer takeCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer>& freeList);
+
+		TvDevice& tvDevice;
+		bool separateTransferQueue;
+		uint32_t transferFamily;
+		uint32_t graphicsFamily;
+
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		TvAllocation stagingAllocation;
+		VkDeviceSize stagingSize;
+		VkDeviceSize copyAlignment = 16;
+		// monotonic byte counters, the actual offset is counter % stagingSize
+		uint64_t ringHead = 0;
+		uint64_t ringTail = 0;
+
+		VkCommandPool transferPool = VK_NULL_HANDLE;
+		VkCommandPool graphicsPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> freeTransferCommands;
+		std::vector<VkCommandBuffer> freeGraphicsCommands;
+
+		// copySemaphore is signaled by the transfer queue, doneSemaphore once the graphics queue took ownership
+		// (they're the same thing without a separate transfer queue, then only doneSemaphore gets used)
+		VkSemaphore copySemaphore = VK_NULL_HANDLE;
+		VkSemaphore doneSemaphore = VK_NULL_HANDLE;
+		Token nextToken = 1;
+		// cached so isComplete doesn't have to ask the driver every time
+		Token completed = 0;
+
+		bool recording = false;
+		Batch recordingBatch;
+		std::deque<Batch> inFlight;
+	};
+}
\ No newline at end of file
@@ -5,7 +5,7 @@
 
 namespace tv
 {
-	TvWindow::TvWindow(int w, int h, std::string name) : width{ w }, height{ h }, windowName{ name }
+	TvWindow::TvWindow(int w, int h, std::string name, bool headless) : width{ w }, height{ h }, windowName{ name }, headless{ headless }
 	{
 		// call our private construction code
 		initWindow();
@@ -13,6 +13,12 @@ namespace tv
 
 	TvWindow::~TvWindow()
 	{
+		// headless windows never started glfw so there's nothing to give back
+		if (headless)
+		{
+			return;
+		}
+
 		// return glfw resoruces and terminate glfw upon deletion of the window
 		glfwDestroyWindow(window);
 		glfwTerminate();
@@ -20,12 +26,42 @@ namespace tv
 
 	void TvWindow::initWindow()
 	{
-		// standard glfw init stuff, but we hint for no api (no creation of opengl stuff) and no resizing
+		// no display on the render farm/CI boxes, so don't even try to init glfw there
+		if (headless)
+		{
+			return;
+		}
+
+		// standard glfw init stuff, but we hint for no api (no creation of opengl stuff)
 		glfwInit();
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 		window = glfwCreateWindow(width, height, windowName.c_str(), nullptr, nullptr);
+		// the callback only gets the glfw window, so stash a pointer back to us on it
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	}
+
+	void TvWindow::framebufferResizeCallback(GLFWwindow* window, int width, int height)
+	{
+		auto tvWindow = reinterpret_cast<TvWindow*>(glfwGetWindowUserPointer(window));
+		tvWindow->framebufferResized = true;
+		tvWindow->width = width;
+		tvWindow->height = height;
+	}
+
+	int TvWindow::getRefreshRate() const
+	{
+		if (headless)
+		{
+			return 0;
+		}
+
+		// good enough for a windowed app, we'd have to track which monitor the window is on to do better
+		GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+		const GLFWvidmode* mode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+		return mode != nullptr ? mode->refreshRate : 0;
 	}
 
 	void TvWindow::createWindowSurface(VkInstance instance, VkSurfaceKHR* surface)
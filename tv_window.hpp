@@ -13,7 +13,8 @@ namespace tv
 	{
 	public:
 		// constructs a window with width, height, and name
-		TvWindow(int w, int h, std::string name);
+		// a headless window never touches GLFW, it just remembers the extent we want to render at
+		TvWindow(int w, int h, std::string name, bool headless = false);
 		~TvWindow();
 
 		// removing the copy operators to prevent memory fuckery
@@ -21,20 +22,36 @@ namespace tv
 		TvWindow& operator = (const TvWindow &) = delete;
 
 		// returns true if GLFW thinks the window should close (user dismisses the window)
-		bool shouldClose() { return glfwWindowShouldClose(window); }
+		// headless windows never close on their own, whoever owns the loop decides when to stop
+		bool shouldClose() { return !headless && glfwWindowShouldClose(window); }
 		
 		// Returns the window width and height as a VkExtent2D (2 uint32)
 		VkExtent2D getExtent() { return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) }; };
 
+		// true if the framebuffer changed size since the last resetWindowResizedFlag (swapchain needs recreating)
+		bool wasWindowResized() const { return framebufferResized; }
+		void resetWindowResizedFlag() { framebufferResized = false; }
+
+		// true if there is no real window (and so no surface/present), see TvSwapChain's offscreen images
+		bool isHeadless() const { return headless; }
+
+		// refresh rate (Hz) of the primary monitor, 0 if we don't know (or there is no monitor)
+		int getRefreshRate() const;
+
 		// creates a Vulkan window surface
 		void createWindowSurface(VkInstance instance, VkSurfaceKHR* surface);
 	private:
+		// glfw calls this whenever the framebuffer gets resized, we just remember the new size
+		static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
+
 		// performs the actual init for the window
 		void initWindow();
-		const int width, height;
+		int width, height;
+		bool framebufferResized = false;
 		std::string windowName;
+		const bool headless;
 
 		// private reference to the GLFW window
-		GLFWwindow *window;
+		GLFWwindow *window = nullptr;
 	};
 }
\ No newline at end of file